@@ -0,0 +1,68 @@
+#include <ESP8266WiFi.h>
+#include <ESP8266AWSIoTMQTTWS.h>  //https://github.com/debsahu/esp8266-arduino-aws-iot-ws
+                                  //https://github.com/Links2004/arduinoWebSockets
+                                  //https://projects.eclipse.org/projects/technology.paho/downloads (download Arduino version)
+
+// Two MQTT connections from one device, e.g. to simulate two things. Each
+// client needs its own params, adapter and a client ID of its own, AWS IoT
+// disconnects a client when another one connects with the same ID.
+
+const char *ssid = "WIFI_SSID";
+const char *password = "WIFI_PASSWORD";
+
+// See `src/aws_iot_config.h` for formatting
+char *region = (char *) "us-east-1";
+char *endpoint = (char *) "xxxxxxxxxxxx";
+char *mqttHost = (char *) "xxxxxxxxxxxx.iot.us-east-1.amazonaws.com";
+int mqttPort = 443;
+char *iamKeyId = (char *) "yyyyyyyyyyyyyyyyyy";
+char *iamSecretKey = (char *) "YYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYY";
+const char* topic  = "fleet/ping";
+
+ESP8266DateTimeProvider dtp;
+AwsIotSigv4 sigv4(&dtp, region, endpoint, mqttHost, mqttPort, iamKeyId, iamSecretKey);
+
+AWSConnectionParams cp1(sigv4, "esp8266-thing-1");
+AWSWebSocketClientAdapter adapter1(cp1);
+AWSMqttClient client1(adapter1, cp1);
+
+AWSConnectionParams cp2(sigv4, "esp8266-thing-2");
+AWSWebSocketClientAdapter adapter2(cp2);
+AWSMqttClient client2(adapter2, cp2);
+
+void setup() {
+
+    Serial.begin(115200);
+    while(!Serial) {
+        yield();
+    }
+
+    WiFi.begin(ssid, password);
+    while (WiFi.status() != WL_CONNECTED) {
+      delay(500);
+      Serial.print(".");
+    }
+
+    int res1 = client1.connect();
+    int res2 = client2.connect();
+    Serial.printf("mqtt connect %s=%d %s=%d\n", cp1.getClientId(), res1, cp2.getClientId(), res2);
+
+    // Thing 2 receives what thing 1 publishes
+    if (res2 == 0) {
+      client2.subscribe(topic, 0,
+        [](const char* topic, const char* msg)
+        { Serial.printf("thing 2 got '%s' on topic %s\n", msg, topic); }
+      );
+    }
+}
+
+void loop() {
+  if (client1.isConnected()) {
+    client1.publish(topic, "ping from thing 1", 0, false);
+  }
+
+  for (int i = 0; i < 10; ++i) {
+    client1.yield(100);
+    client2.yield(100);
+  }
+}
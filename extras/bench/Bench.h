@@ -0,0 +1,49 @@
+/*
+ * Tiny benchmark harness for the host build.
+ *
+ * A benchmark is a function running its operation a given number of times.
+ * The harness picks the iteration count, measures wall time and counts heap
+ * allocations (operator new) per operation.
+ *
+ *  BENCHMARK(sha256_add_1k, 1024) {
+ *    for (size_t i = 0; i < iterations; ++i) { ... }
+ *  }
+ *
+ * The second argument is the number of bytes processed per operation, used
+ * to report throughput. Use 0 if not applicable.
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stddef.h>
+
+typedef void (*BenchFunction)(size_t iterations);
+
+struct Benchmark
+{
+  const char* name;
+  BenchFunction fn;
+  size_t bytesPerOp;
+  Benchmark* next;
+};
+
+/* Registers a benchmark, used by the BENCHMARK macro */
+struct BenchRegistrar
+{
+  BenchRegistrar(Benchmark* b);
+};
+
+/* Number of operator new calls since start */
+size_t benchAllocations();
+
+/* Keeps the compiler from optimising away results */
+void benchSink(const void* p);
+
+#define BENCHMARK(name, bytesPerOp) \
+  static void bench_##name(size_t iterations); \
+  static Benchmark bench_def_##name = { #name, bench_##name, bytesPerOp, 0 }; \
+  static BenchRegistrar bench_reg_##name(&bench_def_##name); \
+  static void bench_##name(size_t iterations)
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ * Benchmarks for the websocket receive buffer.
+ */
+
+#include <Arduino.h>
+#include <thread>
+
+#include "Bench.h"
+#include "ws/CircularByteBuffer.h"
+#include "ws/SpscByteBuffer.h"
+
+namespace {
+
+const size_t CAPACITY = 1024;
+// A typical small MQTT packet. Not a divisor of CAPACITY, so packets
+// regularly wrap around the end of the ring.
+const size_t PACKET = 100;
+
+byte packet[PACKET];
+
+}
+
+// Frame pushed in bulk, then read back byte by byte like Paho does
+BENCHMARK(CircularByteBuffer_bytewise, PACKET)
+{
+  CircularByteBuffer fifo;
+  fifo.init(CAPACITY);
+  for (size_t i = 0; i < iterations; ++i) {
+    fifo.push(packet, PACKET);
+    byte sum = 0;
+    for (size_t j = 0; j < PACKET; ++j) {
+      sum += fifo.pop();
+    }
+    benchSink(&sum);
+  }
+  benchSink(&fifo);
+}
+
+BENCHMARK(CircularByteBuffer_bulk, PACKET)
+{
+  CircularByteBuffer fifo;
+  fifo.init(CAPACITY);
+  byte out[PACKET];
+  for (size_t i = 0; i < iterations; ++i) {
+    fifo.push(packet, PACKET);
+    fifo.pop(out, PACKET);
+    benchSink(out);
+  }
+}
+
+// Frame written and read in place through the spans, same work per byte as
+// the bytewise case
+BENCHMARK(CircularByteBuffer_spanwise, PACKET)
+{
+  CircularByteBuffer fifo;
+  fifo.init(CAPACITY);
+  CircularByteBuffer::Span spans[2];
+  for (size_t i = 0; i < iterations; ++i) {
+    fifo.getWriteSpans(spans);
+    size_t first = PACKET < spans[0].len ? PACKET : spans[0].len;
+    memcpy(spans[0].data, packet, first);
+    memcpy(spans[1].data, packet + first, PACKET - first);
+    fifo.commit(PACKET);
+
+    byte sum = 0;
+    int n = fifo.getReadSpans(spans);
+    for (int s = 0; s < n; ++s) {
+      for (size_t j = 0; j < spans[s].len; ++j) {
+        sum += spans[s].data[j];
+      }
+    }
+    fifo.consume(fifo.getSize());
+    benchSink(&sum);
+  }
+  benchSink(&fifo);
+}
+
+// Same as CircularByteBuffer_bytewise, for the cost of the atomics
+BENCHMARK(SpscByteBuffer_bytewise, PACKET)
+{
+  SpscByteBuffer fifo;
+  fifo.init(CAPACITY);
+  for (size_t i = 0; i < iterations; ++i) {
+    fifo.push(packet, PACKET);
+    byte sum = 0;
+    for (size_t j = 0; j < PACKET; ++j) {
+      sum += fifo.pop();
+    }
+    benchSink(&sum);
+  }
+  benchSink(&fifo);
+}
+
+BENCHMARK(SpscByteBuffer_spanwise, PACKET)
+{
+  SpscByteBuffer fifo;
+  fifo.init(CAPACITY);
+  SpscByteBuffer::Span spans[2];
+  for (size_t i = 0; i < iterations; ++i) {
+    fifo.getWriteSpans(spans);
+    size_t first = PACKET < spans[0].len ? PACKET : spans[0].len;
+    memcpy(spans[0].data, packet, first);
+    memcpy(spans[1].data, packet + first, PACKET - first);
+    fifo.commit(PACKET);
+
+    byte sum = 0;
+    int n = fifo.getReadSpans(spans);
+    for (int s = 0; s < n; ++s) {
+      for (size_t j = 0; j < spans[s].len; ++j) {
+        sum += spans[s].data[j];
+      }
+    }
+    fifo.consume(spans[0].len + spans[1].len);
+    benchSink(&sum);
+  }
+  benchSink(&fifo);
+}
+
+// Packets pushed by another thread, read in place by this one
+BENCHMARK(SpscByteBuffer_threaded, PACKET)
+{
+  SpscByteBuffer fifo;
+  fifo.init(CAPACITY);
+  std::thread producer([&fifo, iterations] () {
+    for (size_t i = 0; i < iterations; ++i) {
+      while (!fifo.push(packet, PACKET)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  size_t total = iterations * PACKET;
+  size_t received = 0;
+  byte sum = 0;
+  SpscByteBuffer::Span spans[2];
+  while (received < total) {
+    int n = fifo.getReadSpans(spans);
+    if (n == 0) {
+      std::this_thread::yield();
+      continue;
+    }
+    for (int s = 0; s < n; ++s) {
+      for (size_t j = 0; j < spans[s].len; ++j) {
+        sum += spans[s].data[j];
+      }
+    }
+    fifo.consume(spans[0].len + spans[1].len);
+    received += spans[0].len + spans[1].len;
+  }
+  producer.join();
+  benchSink(&sum);
+}
@@ -0,0 +1,123 @@
+/*
+ * Throughput of the SHA256 compression backends, and of the multi-buffer
+ * backends on a batch of signature sized HMACs.
+ */
+
+#include "Bench.h"
+#include "aws-sdk-arduino/sha256.h"
+#include "aws-sdk-arduino/sha256mb.h"
+
+namespace {
+
+uint8_t data[4096];
+
+void hashWith(const SHA256Backend* backend, size_t iterations)
+{
+  if (backend == 0 || !SHA256::setBackend(backend)) {
+    return;
+  }
+  SHA256 sha256;
+  for (size_t i = 0; i < iterations; ++i) {
+    sha256.add(data, sizeof(data));
+  }
+  uint8_t hash[32];
+  sha256.finalize(hash);
+  benchSink(hash);
+  SHA256::setBackend(0);
+}
+
+// About the size of a sigv4 string to sign
+const size_t MESSAGE_LEN = 150;
+
+void hmacBatchWith(const Sha256MbBackend* backend, size_t iterations)
+{
+  if (backend == 0 || !Sha256Mb::setBackend(backend)) {
+    return;
+  }
+  HmacSha256 keyed[Sha256Mb::MaxLanes];
+  uint8_t macs[Sha256Mb::MaxLanes][HmacSha256::HashBytes];
+  HmacSha256MbJob jobs[Sha256Mb::MaxLanes];
+  for (size_t i = 0; i < Sha256Mb::MaxLanes; ++i) {
+    keyed[i].setKey(data + i, 32);
+    HmacSha256MbJob job = { &keyed[i], 0, 0, data + 64 * i, MESSAGE_LEN, macs[i] };
+    jobs[i] = job;
+  }
+  for (size_t i = 0; i < iterations; ++i) {
+    Sha256Mb::hmac(jobs, Sha256Mb::MaxLanes);
+    benchSink(macs);
+  }
+  Sha256Mb::setBackend(0);
+}
+
+}
+
+BENCHMARK(SHA256_4k_portable, sizeof(data))
+{
+  hashWith(SHA256::portableBackend(), iterations);
+}
+
+#if defined(SHA256_HAVE_SHANI)
+BENCHMARK(SHA256_4k_shani, sizeof(data))
+{
+  hashWith(SHA256::shaniBackend(), iterations);
+}
+#endif
+
+#if defined(SHA256_HAVE_BEARSSL)
+BENCHMARK(SHA256_4k_bearssl, sizeof(data))
+{
+  hashWith(SHA256::bearsslBackend(), iterations);
+}
+#endif
+
+BENCHMARK(HmacSha256_x8, Sha256Mb::MaxLanes * MESSAGE_LEN)
+{
+  HmacSha256 keyed[Sha256Mb::MaxLanes];
+  for (size_t i = 0; i < Sha256Mb::MaxLanes; ++i) {
+    keyed[i].setKey(data + i, 32);
+  }
+  uint8_t mac[HmacSha256::HashBytes];
+  for (size_t i = 0; i < iterations; ++i) {
+    for (size_t j = 0; j < Sha256Mb::MaxLanes; ++j) {
+      keyed[j].mac(data + 64 * j, MESSAGE_LEN, mac);
+      benchSink(mac);
+    }
+  }
+}
+
+// Baseline for the SIMD backends on hosts without the SHA extensions
+BENCHMARK(HmacSha256_x8_portable, Sha256Mb::MaxLanes * MESSAGE_LEN)
+{
+  if (!SHA256::setBackend(SHA256::portableBackend())) {
+    return;
+  }
+  HmacSha256 keyed[Sha256Mb::MaxLanes];
+  for (size_t i = 0; i < Sha256Mb::MaxLanes; ++i) {
+    keyed[i].setKey(data + i, 32);
+  }
+  uint8_t mac[HmacSha256::HashBytes];
+  for (size_t i = 0; i < iterations; ++i) {
+    for (size_t j = 0; j < Sha256Mb::MaxLanes; ++j) {
+      keyed[j].mac(data + 64 * j, MESSAGE_LEN, mac);
+      benchSink(mac);
+    }
+  }
+  SHA256::setBackend(0);
+}
+
+BENCHMARK(Sha256Mb_hmac_x8_scalar, Sha256Mb::MaxLanes * MESSAGE_LEN)
+{
+  hmacBatchWith(Sha256Mb::scalarBackend(), iterations);
+}
+
+#if defined(SHA256MB_HAVE_SIMD)
+BENCHMARK(Sha256Mb_hmac_x8_sse2, Sha256Mb::MaxLanes * MESSAGE_LEN)
+{
+  hmacBatchWith(Sha256Mb::sse2Backend(), iterations);
+}
+
+BENCHMARK(Sha256Mb_hmac_x8_avx2, Sha256Mb::MaxLanes * MESSAGE_LEN)
+{
+  hmacBatchWith(Sha256Mb::avx2Backend(), iterations);
+}
+#endif
@@ -0,0 +1,109 @@
+/*
+ * Benchmarks for dispatching received messages to topic filters, with the
+ * filters of a gateway subscribed to the shadow topics of many devices.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Bench.h"
+#include "mqtt/TopicTrie.h"
+
+namespace {
+
+const int DEVICES = 200;
+const char* const SHADOW_TOPICS[] = { "update/accepted", "update/rejected", "update/delta" };
+const size_t FILTERS = DEVICES * 3 + 2;
+
+const char TOPIC[] = "$aws/things/device-123/shadow/update/delta";
+
+char filters[FILTERS][64];
+
+void initFilters()
+{
+  size_t n = 0;
+  for (int i = 0; i < DEVICES; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      snprintf(filters[n++], sizeof(filters[0]), "$aws/things/device-%d/shadow/%s", i, SHADOW_TOPICS[j]);
+    }
+  }
+  strcpy(filters[n++], "$aws/things/+/shadow/get/#");
+  strcpy(filters[n++], "gateway/+/status");
+}
+
+void count(const int& handler, void* arg)
+{
+  *(int*) arg += handler;
+}
+
+// Whether filter matches topic, one filter at a time like Paho does
+bool isMatch(const char* filter, const char* topic, size_t len)
+{
+  const char* end = topic + len;
+  while (*filter != '\0' && topic < end) {
+    if (*filter == '#') {
+      return true;
+    }
+    if (*filter == '+') {
+      while (topic < end && *topic != '/') {
+        ++topic;
+      }
+      ++filter;
+    } else {
+      if (*filter != *topic) {
+        return false;
+      }
+      ++filter;
+      ++topic;
+    }
+  }
+  return *filter == '\0' && topic == end;
+}
+
+}
+
+BENCHMARK(TopicTrie_match_602_filters, 0)
+{
+  initFilters();
+  TopicTrie<int> trie;
+  for (size_t i = 0; i < FILTERS; ++i) {
+    trie.add(filters[i], 1);
+  }
+  for (size_t i = 0; i < iterations; ++i) {
+    int matched = 0;
+    trie.match(TOPIC, sizeof(TOPIC) - 1, count, &matched);
+    benchSink(&matched);
+  }
+}
+
+// The same filters tried one by one, for comparison
+BENCHMARK(TopicFilters_linear_602_filters, 0)
+{
+  initFilters();
+  for (size_t i = 0; i < iterations; ++i) {
+    int matched = 0;
+    for (size_t j = 0; j < FILTERS; ++j) {
+      matched += isMatch(filters[j], TOPIC, sizeof(TOPIC) - 1);
+    }
+    benchSink(&matched);
+  }
+}
+
+// Subscribing and unsubscribing one device, with all others subscribed
+BENCHMARK(TopicTrie_add_remove, 0)
+{
+  initFilters();
+  TopicTrie<int> trie;
+  for (size_t i = 3; i < FILTERS; ++i) {
+    trie.add(filters[i], 1);
+  }
+  for (size_t i = 0; i < iterations; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      trie.add(filters[j], 1);
+    }
+    for (size_t j = 0; j < 3; ++j) {
+      trie.remove(filters[j], 1);
+    }
+  }
+  benchSink(&trie);
+}
@@ -0,0 +1,242 @@
+/*
+ * Benchmark runner for the host build.
+ *
+ * Usage:
+ *  bench [--filter <substring>] [--min-time <ms>]
+ *        [--write <baseline file>]
+ *        [--compare <baseline file>] [--tolerance <fraction>]
+ *
+ * --write stores the results as a baseline. --compare runs in regression
+ * mode: the run fails (exit code 1) if any benchmark in the baseline gets
+ * slower than the tolerance allows (default 0.25, i.e. 25%) or allocates
+ * more per operation. Timings are machine dependent, so the baseline should
+ * be recorded on the machine it is compared on. Allocation counts are not.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Bench.h"
+
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size ? size : 1);
+  if (p == 0) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+  free(p);
+}
+
+size_t benchAllocations()
+{
+  return allocations.load(std::memory_order_relaxed);
+}
+
+const void* volatile benchSinkPtr;
+
+void benchSink(const void* p)
+{
+  benchSinkPtr = p;
+}
+
+static Benchmark* benchmarks = 0;
+
+BenchRegistrar::BenchRegistrar(Benchmark* b)
+{
+  // Keep registration order within a file, files are in link order
+  Benchmark** tail = &benchmarks;
+  while (*tail != 0) {
+    tail = &(*tail)->next;
+  }
+  *tail = b;
+}
+
+struct Result
+{
+  char name[64];
+  double nsPerOp;
+  double allocsPerOp;
+};
+
+static const int MAX_RESULTS = 128;
+
+static double runOnce(Benchmark* b, size_t iterations, size_t* allocs)
+{
+  size_t allocsBefore = benchAllocations();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  b->fn(iterations);
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  *allocs = benchAllocations() - allocsBefore;
+  return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+static void run(Benchmark* b, double minTimeNs, Result* r)
+{
+  size_t allocs;
+  // Warm up and calibrate
+  size_t iterations = 1;
+  double ns = runOnce(b, iterations, &allocs);
+  while (ns < minTimeNs / 10 && iterations < ((size_t) 1 << 30)) {
+    iterations *= 10;
+    ns = runOnce(b, iterations, &allocs);
+  }
+  if (ns < minTimeNs) {
+    iterations = (size_t) (iterations * (minTimeNs / (ns > 1 ? ns : 1))) + 1;
+  }
+
+  // Best of five to reduce noise
+  double best = 0;
+  for (int i = 0; i < 5; ++i) {
+    ns = runOnce(b, iterations, &allocs);
+    if (i == 0 || ns < best) {
+      best = ns;
+    }
+  }
+
+  snprintf(r->name, sizeof(r->name), "%s", b->name);
+  r->nsPerOp = best / iterations;
+  r->allocsPerOp = (double) allocs / iterations;
+
+  printf("%-40s %12.1f %10.2f", r->name, r->nsPerOp, r->allocsPerOp);
+  if (b->bytesPerOp > 0) {
+    printf(" %10.1f", b->bytesPerOp * 1000.0 / r->nsPerOp);
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+static bool writeBaseline(const char* file, Result* results, int count)
+{
+  FILE* f = fopen(file, "w");
+  if (f == 0) {
+    fprintf(stderr, "Could not write %s\n", file);
+    return false;
+  }
+  fprintf(f, "# name ns/op allocs/op\n");
+  for (int i = 0; i < count; ++i) {
+    fprintf(f, "%s %.1f %.2f\n", results[i].name, results[i].nsPerOp, results[i].allocsPerOp);
+  }
+  fclose(f);
+  return true;
+}
+
+static bool compareBaseline(const char* file, Result* results, int count, double tolerance)
+{
+  FILE* f = fopen(file, "r");
+  if (f == 0) {
+    fprintf(stderr, "Could not read %s\n", file);
+    return false;
+  }
+
+  printf("\n%-40s %12s %12s %8s\n", "benchmark", "baseline", "current", "change");
+  bool ok = true;
+  char line[256];
+  while (fgets(line, sizeof(line), f) != 0) {
+    Result base;
+    if (line[0] == '#' || sscanf(line, "%63s %lf %lf", base.name, &base.nsPerOp, &base.allocsPerOp) != 3) {
+      continue;
+    }
+    Result* cur = 0;
+    for (int i = 0; i < count; ++i) {
+      if (strcmp(results[i].name, base.name) == 0) {
+        cur = &results[i];
+      }
+    }
+    if (cur == 0) {
+      continue;
+    }
+
+    double change = (cur->nsPerOp - base.nsPerOp) / base.nsPerOp;
+    const char* verdict = "";
+    if (cur->allocsPerOp > base.allocsPerOp + 0.005) {
+      verdict = "REGRESSION (allocs)";
+      ok = false;
+    } else if (change > tolerance) {
+      verdict = "REGRESSION";
+      ok = false;
+    } else if (change < -tolerance) {
+      verdict = "improved";
+    }
+    printf("%-40s %12.1f %12.1f %+7.1f%% %s\n", base.name, base.nsPerOp, cur->nsPerOp, change * 100, verdict);
+  }
+  fclose(f);
+  return ok;
+}
+
+int main(int argc, char** argv)
+{
+  const char* filter = 0;
+  const char* writeFile = 0;
+  const char* compareFile = 0;
+  double tolerance = 0.25;
+  double minTimeMs = 200;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (strcmp(argv[i], "--write") == 0 && i + 1 < argc) {
+      writeFile = argv[++i];
+    } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+      compareFile = argv[++i];
+    } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+      tolerance = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+      minTimeMs = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "Usage: %s [--filter <substring>] [--min-time <ms>] "
+                      "[--write <file>] [--compare <file>] [--tolerance <fraction>]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  static Result results[MAX_RESULTS];
+  int count = 0;
+
+  printf("%-40s %12s %10s %10s\n", "benchmark", "ns/op", "allocs/op", "MB/s");
+  for (Benchmark* b = benchmarks; b != 0 && count < MAX_RESULTS; b = b->next) {
+    if (filter != 0 && strstr(b->name, filter) == 0) {
+      continue;
+    }
+    run(b, minTimeMs * 1e6, &results[count++]);
+  }
+
+  if (writeFile != 0 && !writeBaseline(writeFile, results, count)) {
+    return 2;
+  }
+  if (compareFile != 0 && !compareBaseline(compareFile, results, count, tolerance)) {
+    return 1;
+  }
+  return 0;
+}
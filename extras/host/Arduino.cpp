@@ -0,0 +1,39 @@
+/*
+ * See Arduino.h for description.
+ */
+
+#include "Arduino.h"
+
+#include <chrono>
+#include <thread>
+
+static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+static uint32_t millisOffset = 0;
+
+unsigned long millis()
+{
+  return (uint32_t) (std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start).count() + millisOffset);
+}
+
+unsigned long micros()
+{
+  return (uint32_t) std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+void delay(unsigned long ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void hostSetMillisOffset(uint32_t offset)
+{
+  millisOffset = offset;
+}
+
+void yield()
+{
+  std::this_thread::yield();
+}
@@ -0,0 +1,32 @@
+/*
+ * Minimal Arduino core shim for building the platform independent parts of
+ * the library on a host (Linux) machine, e.g. for benchmarks.
+ *
+ * Only what the host build actually uses is provided.
+ */
+
+#ifndef HOST_ARDUINO_H_
+#define HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+typedef uint8_t byte;
+
+/* Milliseconds since start, wraps around like on the device */
+unsigned long millis();
+
+/* Microseconds since start, wraps around like on the device */
+unsigned long micros();
+
+void delay(unsigned long ms);
+
+/* Host only: shift millis() by offset ms, e.g. to test wrapping around */
+void hostSetMillisOffset(uint32_t offset);
+
+void yield();
+
+#endif
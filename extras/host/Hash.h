@@ -0,0 +1,9 @@
+/*
+ * ESP8266 Hash library for the host build, see Arduino.h. Included by
+ * arduinoWebSockets users, nothing of it is used.
+ */
+
+#ifndef HOST_HASH_H_
+#define HOST_HASH_H_
+
+#endif
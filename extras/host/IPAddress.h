@@ -0,0 +1,18 @@
+/*
+ * Arduino IPAddress for the host build, see Arduino.h. Only constructed,
+ * never looked at.
+ */
+
+#ifndef HOST_IPADDRESS_H_
+#define HOST_IPADDRESS_H_
+
+#include "Arduino.h"
+
+class IPAddress
+{
+  public:
+    IPAddress() {}
+    IPAddress(uint8_t, uint8_t, uint8_t, uint8_t) {}
+};
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * See WebSocketsClient.h for description.
+ */
+
+#include "WebSocketsClient.h"
+
+WebSocketsClient* WebSocketsClient::hostLast = NULL;
+
+WebSocketsClient::WebSocketsClient() :
+  hostLoops(0),
+  state(DISCONNECTED)
+{
+  hostLast = this;
+}
+
+WebSocketsClient::~WebSocketsClient()
+{
+  if (hostLast == this) {
+    hostLast = NULL;
+  }
+}
+
+void WebSocketsClient::begin(const char*, uint16_t, const char*, const char*)
+{
+  state = HANDSHAKE;
+}
+
+void WebSocketsClient::beginSSL(const char*, uint16_t, const char*, const char*, const char*)
+{
+  state = HANDSHAKE;
+}
+
+void WebSocketsClient::loop()
+{
+  hostLoops++;
+  if (state == HANDSHAKE) {
+    state = CONNECTED;
+    if (onEventCb) {
+      onEventCb(WStype_CONNECTED, NULL, 0);
+    }
+    return;
+  }
+  if (state == CONNECTED && !frames.empty()) {
+    std::string frame = frames.front();
+    frames.pop_front();
+    if (onEventCb) {
+      onEventCb(WStype_BIN, (uint8_t*) &frame[0], frame.size());
+    }
+  }
+}
+
+void WebSocketsClient::onEvent(WebSocketClientEvent cbEvent)
+{
+  onEventCb = cbEvent;
+}
+
+bool WebSocketsClient::sendBIN(uint8_t* payload, size_t length, bool headerToPayload)
+{
+  if (state != CONNECTED) {
+    return false;
+  }
+  // With headerToPayload, the payload starts after room for the header
+  const uint8_t* data = headerToPayload ? payload + WEBSOCKETS_MAX_HEADER_SIZE : payload;
+  hostSent.push_back(std::string((const char*) data, length));
+  return true;
+}
+
+bool WebSocketsClient::sendBIN(const uint8_t* payload, size_t length)
+{
+  return sendBIN((uint8_t*) payload, length, false);
+}
+
+void WebSocketsClient::disconnect()
+{
+  State was = state;
+  state = DISCONNECTED;
+  frames.clear();
+  if (was != DISCONNECTED && onEventCb) {
+    onEventCb(WStype_DISCONNECTED, NULL, 0);
+  }
+}
+
+bool WebSocketsClient::isConnected()
+{
+  return state == CONNECTED;
+}
+
+void WebSocketsClient::hostQueueFrame(const uint8_t* payload, size_t length)
+{
+  frames.push_back(std::string((const char*) payload, length));
+}
@@ -0,0 +1,73 @@
+/*
+ * Stand-in for the arduinoWebSockets client in the host build, to test
+ * AWSWebSocketClientAdapter without a network.
+ *
+ * The handshake completes on the first loop() after begin(). Frames queued
+ * with hostQueueFrame() are received one per loop(), like arduinoWebSockets
+ * handles one frame per loop(). Sent frames are collected in hostSent.
+ */
+
+#ifndef HOST_WEBSOCKETSCLIENT_H_
+#define HOST_WEBSOCKETSCLIENT_H_
+
+#include <deque>
+#include <functional>
+#include <string>
+
+#include "Arduino.h"
+
+#define WEBSOCKETS_MAX_HEADER_SIZE (14)
+
+typedef enum {
+  WStype_ERROR,
+  WStype_DISCONNECTED,
+  WStype_CONNECTED,
+  WStype_TEXT,
+  WStype_BIN,
+  WStype_FRAGMENT_TEXT_START,
+  WStype_FRAGMENT_BIN_START,
+  WStype_FRAGMENT,
+  WStype_FRAGMENT_FIN,
+  WStype_PING,
+  WStype_PONG
+} WStype_t;
+
+class WebSocketsClient
+{
+  public:
+    typedef std::function<void (WStype_t type, uint8_t* payload, size_t length)> WebSocketClientEvent;
+
+    WebSocketsClient();
+    ~WebSocketsClient();
+
+    void begin(const char* host, uint16_t port, const char* url = "/", const char* protocol = "arduino");
+    void beginSSL(const char* host, uint16_t port, const char* url = "/", const char* fingerprint = "",
+                  const char* protocol = "arduino");
+    void loop();
+    void onEvent(WebSocketClientEvent cbEvent);
+    bool sendBIN(uint8_t* payload, size_t length, bool headerToPayload = false);
+    bool sendBIN(const uint8_t* payload, size_t length);
+    void disconnect();
+    bool isConnected();
+
+    /* Host only: the last instance created, e.g. the one of an adapter */
+    static WebSocketsClient* hostLast;
+
+    /* Host only: receive a binary frame on a later loop() */
+    void hostQueueFrame(const uint8_t* payload, size_t length);
+
+    /* Host only: payloads of the frames sent, in order */
+    std::deque<std::string> hostSent;
+
+    /* Host only: number of loop() calls */
+    unsigned long hostLoops;
+
+  private:
+    enum State { DISCONNECTED, HANDSHAKE, CONNECTED };
+
+    State state;
+    WebSocketClientEvent onEventCb;
+    std::deque<std::string> frames;
+};
+
+#endif
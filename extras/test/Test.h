@@ -0,0 +1,36 @@
+/*
+ * Minimal checks for the host tests. Each test is a separate executable that
+ * returns the number of failed checks.
+ */
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+#include <string.h>
+
+static int testFailures = 0;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      testFailures++; \
+    } \
+  } while (0)
+
+#define CHECK_STR(actual, expected) \
+  do { \
+    const char* a_ = (actual); \
+    const char* e_ = (expected); \
+    if (a_ == 0 || strcmp(a_, e_) != 0) { \
+      fprintf(stderr, "%s:%d: CHECK_STR(%s) failed\n  actual:   %s\n  expected: %s\n", \
+              __FILE__, __LINE__, #actual, a_ ? a_ : "(null)", e_); \
+      testFailures++; \
+    } \
+  } while (0)
+
+#define TEST_RESULT() \
+  (printf("%s\n", testFailures == 0 ? "OK" : "FAILED"), testFailures)
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * HttpDateParser: Date header in various positions, split across chunks,
+ * month names and malformed or missing headers.
+ */
+
+#include "Test.h"
+#include "aws/DateTime.h"
+#include "aws/HttpDateParser.h"
+
+static const char RESPONSE[] =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Server: CloudFront\r\n"
+    "Date: Mon, 08 May 2017 12:30:58 GMT\r\n"
+    "Content-Type: text/html\r\n"
+    "\r\n"
+    "<html>...</html>";
+
+static HttpDateParser::State parse(const char* response, uint32_t* epoch)
+{
+  HttpDateParser parser;
+  parser.feed(response, strlen(response));
+  *epoch = parser.getEpoch();
+  return parser.getState();
+}
+
+static const char* dateOf(const char* response)
+{
+  static char dateTime[DATE_TIME_LEN + 1];
+  uint32_t epoch;
+  if (parse(response, &epoch) != HttpDateParser::DONE) {
+    return 0;
+  }
+  epochToDateTime(epoch, dateTime);
+  return dateTime;
+}
+
+static void testParse()
+{
+  uint32_t epoch;
+  CHECK(parse(RESPONSE, &epoch) == HttpDateParser::DONE);
+  CHECK(epoch == 1494246658);
+
+  // Stops right after the Date header
+  HttpDateParser parser;
+  size_t consumed = parser.feed(RESPONSE, sizeof(RESPONSE) - 1);
+  CHECK(consumed == (size_t) (strstr(RESPONSE, "Content-Type") - RESPONSE));
+
+  // Name is case insensitive, line endings may be bare LF
+  CHECK_STR(dateOf("HTTP/1.1 200 OK\nDATE:Sun, 06 Nov 1994 08:49:37 GMT\n"), "19941106084937");
+  CHECK_STR(dateOf("HTTP/1.1 200 OK\ndate: \tSun, 06 Nov 1994 08:49:37 GMT  \n"), "19941106084937");
+}
+
+static void testChunks()
+{
+  // Every split point, including one byte at a time
+  for (size_t chunk = 1; chunk < sizeof(RESPONSE); ++chunk) {
+    HttpDateParser parser;
+    for (size_t i = 0; i < sizeof(RESPONSE) - 1 && parser.getState() == HttpDateParser::PARSING; i += chunk) {
+      size_t n = sizeof(RESPONSE) - 1 - i < chunk ? sizeof(RESPONSE) - 1 - i : chunk;
+      parser.feed(RESPONSE + i, n);
+    }
+    CHECK(parser.getState() == HttpDateParser::DONE);
+    CHECK(parser.getEpoch() == 1494246658);
+  }
+
+  // Reusable after reset
+  HttpDateParser parser;
+  parser.feed("HTTP/1.1 200 OK\r\n\r\n", 19);
+  CHECK(parser.getState() == HttpDateParser::FAILED);
+  parser.reset();
+  parser.feed(RESPONSE, sizeof(RESPONSE) - 1);
+  CHECK(parser.getState() == HttpDateParser::DONE);
+}
+
+static void testMonths()
+{
+  static const char* names[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                 "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+  for (int i = 0; i < 12; ++i) {
+    char response[128];
+    char expected[DATE_TIME_LEN + 1];
+    snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nDate: Tue, 01 %s 2030 00:00:00 GMT\r\n", names[i]);
+    snprintf(expected, sizeof(expected), "2030%02d01000000", i + 1);
+    CHECK_STR(dateOf(response), expected);
+  }
+
+  CHECK(dateOf("HTTP/1.1 200 OK\r\nDate: Tue, 01 JAN 2030 00:00:00 GMT\r\n") != 0);
+  CHECK(dateOf("HTTP/1.1 200 OK\r\nDate: Tue, 01 Jun 2030 00:00:00 GMT\r\n") != 0);
+  // Same hash as a month, but not a month
+  CHECK(dateOf("HTTP/1.1 200 OK\r\nDate: Tue, 01 Xan 2030 00:00:00 GMT\r\n") == 0);
+  CHECK(dateOf("HTTP/1.1 200 OK\r\nDate: Tue, 01 Jbn 2030 00:00:00 GMT\r\n") == 0);
+}
+
+static void testInvalid()
+{
+  uint32_t epoch;
+
+  // No Date header before the end of the headers, body is not looked at
+  CHECK(parse("HTTP/1.1 200 OK\r\nServer: x\r\n\r\nDate: Mon, 08 May 2017 12:30:58 GMT\r\n", &epoch) ==
+        HttpDateParser::FAILED);
+
+  // Status line is not a header
+  CHECK(parse("Date: Mon, 08 May 2017 12:30:58 GMT\r\n", &epoch) == HttpDateParser::PARSING);
+
+  // Incomplete line
+  CHECK(parse("HTTP/1.1 200 OK\r\nDate: Mon, 08 May 2017 12:30:58 GMT", &epoch) == HttpDateParser::PARSING);
+
+  // Obsolete formats, bad fields and out of range values
+  CHECK(parse("HTTP/1.1 200 OK\r\nDate: Monday, 08-May-17 12:30:58 GMT\r\n", &epoch) == HttpDateParser::FAILED);
+  CHECK(parse("HTTP/1.1 200 OK\r\nDate: Mon May  8 12:30:58 2017\r\n", &epoch) == HttpDateParser::FAILED);
+  CHECK(parse("HTTP/1.1 200 OK\r\nDate: Mon, 08 May 2017 12:30:58 CET\r\n", &epoch) == HttpDateParser::FAILED);
+  CHECK(parse("HTTP/1.1 200 OK\r\nDate: Mon, 8 May 2017 12:30:58 GMT\r\n", &epoch) == HttpDateParser::FAILED);
+  CHECK(parse("HTTP/1.1 200 OK\r\nDate: Mon, 08 May 2017 12:30\r\n", &epoch) == HttpDateParser::FAILED);
+  CHECK(parse("HTTP/1.1 200 OK\r\nDate: Thu, 31 Apr 2017 12:30:58 GMT\r\n", &epoch) == HttpDateParser::FAILED);
+  CHECK(parse("HTTP/1.1 200 OK\r\nDate: Mon, 08 May 2017 24:30:58 GMT\r\n", &epoch) == HttpDateParser::FAILED);
+  CHECK(parse("HTTP/1.1 200 OK\r\nDate:\r\n", &epoch) == HttpDateParser::FAILED);
+
+  // Not the Date header
+  CHECK(parse("HTTP/1.1 200 OK\r\nDates: Mon, 08 May 2017 12:30:58 GMT\r\n\r\n", &epoch) == HttpDateParser::FAILED);
+  CHECK(parse("HTTP/1.1 200 OK\r\nX-Date: Mon, 08 May 2017 12:30:58 GMT\r\n\r\n", &epoch) == HttpDateParser::FAILED);
+
+  // Long lines are truncated without harm
+  char response[1024] = "HTTP/1.1 200 OK\r\nSet-Cookie: ";
+  size_t len = strlen(response);
+  memset(response + len, 'x', 800);
+  strcpy(response + len + 800, "\r\nDate: Mon, 08 May 2017 12:30:58 GMT\r\n");
+  CHECK(parse(response, &epoch) == HttpDateParser::DONE);
+  CHECK(epoch == 1494246658);
+}
+
+int main()
+{
+  testParse();
+  testChunks();
+  testMonths();
+  testInvalid();
+  return TEST_RESULT();
+}
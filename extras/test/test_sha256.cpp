@@ -0,0 +1,224 @@
+/*
+ * SHA256 backends against the NIST FIPS 180-2 example vectors, and against
+ * each other for all message lengths around the block boundaries. The
+ * multi-buffer backends are checked against SHA256 and HmacSha256.
+ */
+
+#include <stdlib.h>
+
+#include "Test.h"
+#include "aws-sdk-arduino/sha256.h"
+#include "aws-sdk-arduino/hmacsha256.h"
+#include "aws-sdk-arduino/sha256mb.h"
+
+struct Vector
+{
+  const char* message;
+  size_t repeat;
+  const char* hash;
+};
+
+static const Vector NIST_VECTORS[] = {
+  { "", 1,
+    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+  { "abc", 1,
+    "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+  { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+    "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+  { "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", 1,
+    "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+  { "a", 1000000,
+    "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+};
+
+static void hashVector(const Vector& v, char* out)
+{
+  SHA256 sha256;
+  size_t len = strlen(v.message);
+  for (size_t i = 0; i < v.repeat; ++i) {
+    sha256.add(v.message, len);
+  }
+  sha256.finalizeHex(out);
+}
+
+static void testNistVectors()
+{
+  for (size_t i = 0; i < sizeof(NIST_VECTORS) / sizeof(NIST_VECTORS[0]); ++i) {
+    char hash[65];
+    hashVector(NIST_VECTORS[i], hash);
+    CHECK_STR(hash, NIST_VECTORS[i].hash);
+  }
+
+  // Legacy allocating API
+  SHA256 sha256;
+  char* hash = sha256("abc", 3);
+  CHECK_STR(hash, NIST_VECTORS[1].hash);
+  delete[] hash;
+}
+
+// Hash data[0..len) in pseudo random chunks, unaligned
+static void hashChunked(const uint8_t* data, size_t len, unsigned int seed, uint8_t* out)
+{
+  SHA256 sha256;
+  srand(seed);
+  size_t off = 0;
+  while (off < len) {
+    size_t n = rand() % 150;
+    if (n > len - off) {
+      n = len - off;
+    }
+    sha256.add(data + off, n);
+    off += n;
+  }
+  sha256.finalize(out);
+}
+
+static void testEquivalence(const SHA256Backend* backend)
+{
+  static uint8_t data[1025];
+  for (size_t i = 0; i < sizeof(data); ++i) {
+    data[i] = (uint8_t) (i * 31 + 7);
+  }
+
+  for (size_t len = 0; len < 600; ++len) {
+    uint8_t expected[32];
+    uint8_t actual[32];
+    CHECK(SHA256::setBackend(SHA256::portableBackend()));
+    hashChunked(data + 1, len, len, expected);
+    CHECK(SHA256::setBackend(backend));
+    hashChunked(data + 1, len, len, actual);
+    CHECK(memcmp(expected, actual, 32) == 0);
+  }
+}
+
+// RFC 4231 test case 2
+static void testHmac()
+{
+  HmacSha256 hmac("Jefe", 4);
+  uint8_t mac[HmacSha256::HashBytes];
+  hmac.mac("what do ya want for nothing?", 28, mac);
+  static const uint8_t expected[] = {
+    0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e, 0x6a, 0x04, 0x24, 0x26, 0x08, 0x95, 0x75, 0xc7,
+    0x5a, 0x00, 0x3f, 0x08, 0x9d, 0x27, 0x39, 0x83, 0x9d, 0xec, 0x58, 0xb9, 0x64, 0xec, 0x38, 0x43
+  };
+  CHECK(memcmp(mac, expected, sizeof(expected)) == 0);
+}
+
+// Messages of mixed lengths, more than one group, some with a midstate
+static void testMultiBuffer(const Sha256MbBackend* backend)
+{
+  static uint8_t data[20][300];
+  static const size_t COUNT = sizeof(data) / sizeof(data[0]);
+  srand(1);
+  for (size_t i = 0; i < COUNT; ++i) {
+    for (size_t j = 0; j < sizeof(data[i]); ++j) {
+      data[i][j] = (uint8_t) rand();
+    }
+  }
+
+  for (int round = 0; round < 20; ++round) {
+    size_t lens[COUNT];
+    for (size_t i = 0; i < COUNT; ++i) {
+      lens[i] = rand() % sizeof(data[i]);
+    }
+
+    // plain and continued from the midstate after one block
+    Sha256MbJob jobs[COUNT];
+    uint8_t actual[COUNT][32];
+    uint32_t midstates[COUNT][8];
+    for (size_t i = 0; i < COUNT; ++i) {
+      Sha256MbJob job = { data[i], lens[i], 0, 0, actual[i] };
+      if (i % 3 == 1 && lens[i] >= 64) {
+        SHA256 prefix;
+        prefix.add(data[i], 64);
+        prefix.getState(midstates[i]);
+        job.data = data[i] + 64;
+        job.len = lens[i] - 64;
+        job.midstate = midstates[i];
+        job.prefixLen = 64;
+      }
+      jobs[i] = job;
+    }
+    CHECK(Sha256Mb::setBackend(backend));
+    Sha256Mb::hash(jobs, COUNT);
+    for (size_t i = 0; i < COUNT; ++i) {
+      uint8_t expected[32];
+      SHA256 sha256;
+      sha256.add(data[i], lens[i]);
+      sha256.finalize(expected);
+      CHECK(memcmp(expected, actual[i], 32) == 0);
+    }
+
+    // raw keys (including one longer than a block) and keyed contexts
+    HmacSha256 keyed[COUNT];
+    HmacSha256MbJob hmacJobs[COUNT];
+    for (size_t i = 0; i < COUNT; ++i) {
+      size_t keyLen = i == 0 ? 100 : i + 1;
+      HmacSha256MbJob job = { 0, data[COUNT - 1 - i], keyLen, data[i], lens[i], actual[i] };
+      if (i % 2 == 1) {
+        keyed[i].setKey(job.key, job.keyLen);
+        job.keyed = &keyed[i];
+        job.key = 0;
+      }
+      hmacJobs[i] = job;
+    }
+    Sha256Mb::hmac(hmacJobs, COUNT);
+    for (size_t i = 0; i < COUNT; ++i) {
+      uint8_t expected[32];
+      HmacSha256 hmac(data[COUNT - 1 - i], i == 0 ? 100 : i + 1);
+      hmac.mac(data[i], lens[i], expected);
+      CHECK(memcmp(expected, actual[i], 32) == 0);
+    }
+  }
+}
+
+int main()
+{
+  const SHA256Backend* backends[] = {
+    SHA256::portableBackend(), SHA256::shaniBackend(), SHA256::bearsslBackend()
+  };
+
+  for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+    const SHA256Backend* backend = backends[i];
+    if (backend == 0) {
+      continue;
+    }
+    if (!backend->isAvailable()) {
+      printf("backend %s: not available, skipped\n", backend->name);
+      continue;
+    }
+    printf("backend %s\n", backend->name);
+    CHECK(SHA256::setBackend(backend));
+    CHECK(SHA256::getBackend() == backend);
+    testNistVectors();
+    testHmac();
+    testEquivalence(backend);
+  }
+
+  // Automatic selection picks an available backend
+  CHECK(SHA256::setBackend(0));
+  CHECK(SHA256::getBackend()->isAvailable());
+  printf("default backend %s\n", SHA256::getBackend()->name);
+
+  const Sha256MbBackend* mbBackends[] = {
+    Sha256Mb::scalarBackend(), Sha256Mb::sse2Backend(), Sha256Mb::avx2Backend()
+  };
+
+  for (size_t i = 0; i < sizeof(mbBackends) / sizeof(mbBackends[0]); ++i) {
+    const Sha256MbBackend* backend = mbBackends[i];
+    if (backend == 0) {
+      continue;
+    }
+    if (!backend->isAvailable()) {
+      printf("multi-buffer backend %s: not available, skipped\n", backend->name);
+      continue;
+    }
+    printf("multi-buffer backend %s\n", backend->name);
+    testMultiBuffer(backend);
+  }
+
+  CHECK(Sha256Mb::setBackend(0));
+  printf("default multi-buffer backend %s\n", Sha256Mb::getBackend()->name);
+
+  return TEST_RESULT();
+}
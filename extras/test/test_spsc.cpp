@@ -0,0 +1,177 @@
+/*
+ * SpscByteBuffer: single threaded behaviour, and a producer and a consumer
+ * thread moving a known byte sequence through a small ring with all the
+ * push and pop variants. Run under ThreadSanitizer to check the ordering.
+ */
+
+#include <atomic>
+#include <thread>
+
+#include "Test.h"
+#include "Arduino.h"
+#include "ws/SpscByteBuffer.h"
+
+// Byte number i of the sequence
+static byte sequence(size_t i)
+{
+  return (byte) (i * 7 + (i >> 8));
+}
+
+static void testSingleThread()
+{
+  SpscByteBuffer fifo;
+  fifo.init(100);
+  CHECK(fifo.getCapacity() == 128);
+  CHECK(fifo.getSize() == 0);
+  CHECK(fifo.getFree() == 128);
+  CHECK(fifo.pop() == 0);
+
+  byte in[128];
+  byte out[128];
+  for (size_t i = 0; i < sizeof(in); ++i) {
+    in[i] = sequence(i);
+  }
+
+  // Whole capacity is usable, all or nothing
+  CHECK(fifo.push(in, 100));
+  CHECK(!fifo.push(in, 29));
+  CHECK(fifo.push(in + 100, 28));
+  CHECK(fifo.getFree() == 0);
+  CHECK(fifo.getHighWaterMark() == 128);
+  CHECK(fifo.pop(out, 129) == NULL);
+  CHECK(fifo.pop(out, 128) == out);
+  CHECK(memcmp(in, out, 128) == 0);
+
+  // Wrap around, in two spans
+  fifo.clear();
+  CHECK(fifo.push(in, 100));
+  CHECK(fifo.pop(out, 100) == out);
+  CHECK(fifo.push(in, 60));
+  SpscByteBuffer::Span spans[2];
+  CHECK(fifo.getReadSpans(spans) == 2);
+  CHECK(spans[0].len == 28 && spans[1].len == 32);
+  CHECK(memcmp(spans[0].data, in, 28) == 0);
+  CHECK(memcmp(spans[1].data, in + 28, 32) == 0);
+  fifo.consume(60);
+  CHECK(fifo.getSize() == 0);
+  CHECK(fifo.getWriteSpans(spans) == 2);
+  CHECK(spans[0].len + spans[1].len == 128);
+
+  fifo.push(42);
+  CHECK(fifo.peek() == 42);
+  CHECK(fifo.pop() == 42);
+}
+
+static void testThreads(size_t total)
+{
+  SpscByteBuffer fifo;
+  fifo.init(256);
+  std::atomic<bool> failed(false);
+
+  std::thread producer([&fifo, &failed, total] () {
+    byte chunk[300];
+    size_t sent = 0;
+    unsigned seed = 1;
+    while (sent < total && !failed.load()) {
+      size_t before = sent;
+      seed = seed * 1103515245 + 12345;
+      size_t len = (seed >> 16) % 300;
+      if (len > total - sent) {
+        len = total - sent;
+      }
+      switch ((seed >> 8) % 3) {
+        case 0:
+          for (size_t i = 0; i < len; ++i) {
+            chunk[i] = sequence(sent + i);
+          }
+          if (fifo.push(chunk, len)) {
+            sent += len;
+          }
+          break;
+        case 1:
+          if (fifo.getFree() > 0) {
+            fifo.push(sequence(sent));
+            sent++;
+          }
+          break;
+        default: {
+          SpscByteBuffer::Span spans[2];
+          fifo.getWriteSpans(spans);
+          size_t n = 0;
+          for (int s = 0; s < 2; ++s) {
+            for (size_t i = 0; i < spans[s].len && n < len; ++i, ++n) {
+              spans[s].data[i] = sequence(sent + n);
+            }
+          }
+          fifo.commit(n);
+          sent += n;
+          break;
+        }
+      }
+      // Let the consumer run if this is a single core
+      if (sent == before) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  byte chunk[300];
+  size_t received = 0;
+  unsigned seed = 2;
+  int errors = 0;
+  while (received < total && errors == 0) {
+    size_t before = received;
+    seed = seed * 1103515245 + 12345;
+    size_t len = (seed >> 16) % 300;
+    if (len > total - received) {
+      len = total - received;
+    }
+    switch ((seed >> 8) % 3) {
+      case 0:
+        if (fifo.pop(chunk, len) != NULL) {
+          for (size_t i = 0; i < len; ++i) {
+            errors += chunk[i] != sequence(received + i);
+          }
+          received += len;
+        }
+        break;
+      case 1:
+        if (fifo.getSize() > 0) {
+          errors += fifo.peek() != sequence(received);
+          errors += fifo.pop() != sequence(received);
+          received++;
+        }
+        break;
+      default: {
+        SpscByteBuffer::Span spans[2];
+        fifo.getReadSpans(spans);
+        size_t n = 0;
+        for (int s = 0; s < 2; ++s) {
+          for (size_t i = 0; i < spans[s].len && n < len; ++i, ++n) {
+            errors += spans[s].data[i] != sequence(received + n);
+          }
+        }
+        fifo.consume(n);
+        received += n;
+        break;
+      }
+    }
+    if (received == before) {
+      std::this_thread::yield();
+    }
+  }
+
+  failed.store(errors != 0);
+  producer.join();
+  CHECK(errors == 0);
+  CHECK(received == total);
+  CHECK(fifo.getSize() == 0);
+  CHECK(fifo.getHighWaterMark() <= 256);
+}
+
+int main()
+{
+  testSingleThread();
+  testThreads(10000000);
+  return TEST_RESULT();
+}
@@ -0,0 +1,220 @@
+/*
+ * TopicTrie: matching with and without wildcards, several handlers per
+ * filter, removal and changes made from a visitor.
+ */
+
+#include "Test.h"
+#include "mqtt/TopicTrie.h"
+
+typedef TopicTrie<int> Trie;
+
+// Sum of the handlers called, each handler is a power of two
+static void sum(const int& handler, void* arg)
+{
+  *(int*) arg += handler;
+}
+
+static int matches(const Trie& trie, const char* topic)
+{
+  int s = 0;
+  trie.match(topic, strlen(topic), sum, &s);
+  return s;
+}
+
+static void testExact()
+{
+  Trie trie;
+  CHECK(matches(trie, "a/b") == 0);
+
+  CHECK(trie.add("a/b", 1));
+  CHECK(trie.add("a/b/c", 2));
+  CHECK(trie.add("a", 4));
+  CHECK(trie.add("/a", 8));
+  CHECK(trie.add("a//b", 16));
+  CHECK(trie.getSize() == 5);
+
+  CHECK(matches(trie, "a/b") == 1);
+  CHECK(matches(trie, "a/b/c") == 2);
+  CHECK(matches(trie, "a") == 4);
+  CHECK(matches(trie, "/a") == 8);
+  CHECK(matches(trie, "a//b") == 16);
+  CHECK(matches(trie, "a/") == 0);
+  CHECK(matches(trie, "a/bc") == 0);
+  CHECK(matches(trie, "b") == 0);
+  CHECK(matches(trie, "") == 0);
+
+  // Only len bytes are looked at
+  int s = 0;
+  CHECK(trie.match("a/b/c", 3, sum, &s) == 1);
+  CHECK(s == 1);
+}
+
+static void testWildcards()
+{
+  Trie trie;
+  CHECK(trie.add("a/+", 1));
+  CHECK(trie.add("a/#", 2));
+  CHECK(trie.add("+/b/+", 4));
+  CHECK(trie.add("#", 8));
+  CHECK(trie.add("+", 16));
+  CHECK(trie.add("a/+/c", 32));
+
+  CHECK(matches(trie, "a") == 2 + 8 + 16);
+  CHECK(matches(trie, "a/b") == 1 + 2 + 8);
+  CHECK(matches(trie, "a/") == 1 + 2 + 8);
+  CHECK(matches(trie, "a/b/c") == 2 + 4 + 8 + 32);
+  CHECK(matches(trie, "x/b/y") == 4 + 8);
+  CHECK(matches(trie, "x/b") == 8);
+  CHECK(matches(trie, "") == 8 + 16);
+
+  // No wildcards on the first level of $ topics
+  CHECK(matches(trie, "$aws/b/c") == 0);
+  CHECK(trie.add("$aws/things/+/shadow/#", 64));
+  CHECK(matches(trie, "$aws/things/dev1/shadow/update/accepted") == 64);
+  CHECK(matches(trie, "$aws/things/dev1/shadow") == 64);
+  CHECK(matches(trie, "$aws/things/dev1/jobs") == 0);
+}
+
+static void testHandlers()
+{
+  Trie trie;
+  bool added;
+  CHECK(trie.add("a/+", 1, &added) && added);
+  CHECK(trie.add("a/+", 2));
+  CHECK(trie.add("a/+", 1, &added) && !added);
+  CHECK(!trie.add("a/+/#/b", 1, &added) && !added);
+  CHECK(trie.getSize() == 2);
+  CHECK(matches(trie, "a/b") == 3);
+
+  CHECK(!trie.remove("a/+", 4));
+  CHECK(!trie.remove("a/b", 1));
+  CHECK(trie.remove("a/+", 1));
+  CHECK(matches(trie, "a/b") == 2);
+  CHECK(trie.add("a/+", 4));
+  CHECK(trie.add("a/b", 8));
+  CHECK(matches(trie, "a/b") == 2 + 4 + 8);
+
+  CHECK(trie.removeAll("a/+") == 2);
+  CHECK(trie.removeAll("a/+") == 0);
+  CHECK(matches(trie, "a/b") == 8);
+  CHECK(trie.remove("a/b", 8));
+  CHECK(trie.getSize() == 0);
+  CHECK(matches(trie, "a/b") == 0);
+
+  // Order of adding is kept
+  CHECK(trie.add("x", 1));
+  CHECK(trie.add("x", 2));
+  CHECK(trie.add("x", 3));
+  int order[3];
+  int* p = order;
+  trie.match("x", 1, [](const int& h, void* arg) { *(*(int**) arg)++ = h; }, &p);
+  CHECK(order[0] == 1 && order[1] == 2 && order[2] == 3);
+
+  trie.clear();
+  CHECK(trie.getSize() == 0);
+  CHECK(matches(trie, "x") == 0);
+  CHECK(trie.add("x", 1));
+  CHECK(matches(trie, "x") == 1);
+}
+
+static void testInvalid()
+{
+  Trie trie;
+  CHECK(!trie.add("", 1));
+  CHECK(!trie.add(NULL, 1));
+  CHECK(!trie.add("a/b#", 1));
+  CHECK(!trie.add("a/#/b", 1));
+  CHECK(!trie.add("a+/b", 1));
+  CHECK(!trie.add("a/++", 1));
+  CHECK(!trie.add("##", 1));
+  CHECK(trie.getSize() == 0);
+
+  CHECK(Trie::isValidFilter("+/+"));
+  CHECK(Trie::isValidFilter("/"));
+  CHECK(Trie::isValidFilter("a/+/#"));
+}
+
+static void testMany()
+{
+  // Enough nodes to grow and rehash several times, removed in another
+  // order than added
+  Trie trie;
+  char filter[64];
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(filter, sizeof(filter), "$aws/things/dev%d/shadow/update/%s", i, i % 2 ? "delta" : "accepted");
+    CHECK(trie.add(filter, i));
+  }
+  CHECK(trie.getSize() == 1000);
+
+  for (int i = 0; i < 1000; i += 3) {
+    snprintf(filter, sizeof(filter), "$aws/things/dev%d/shadow/update/%s", i, i % 2 ? "delta" : "accepted");
+    CHECK(trie.remove(filter, i));
+  }
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(filter, sizeof(filter), "$aws/things/dev%d/shadow/update/%s", i, i % 2 ? "delta" : "accepted");
+    int s = -1;
+    size_t n = trie.match(filter, strlen(filter), [](const int& h, void* arg) { *(int*) arg = h; }, &s);
+    CHECK(n == (i % 3 == 0 ? 0u : 1u));
+    CHECK(s == (i % 3 == 0 ? -1 : i));
+  }
+}
+
+static Trie* modified;
+
+static int called;
+
+static void testModify()
+{
+  // Removing from a visitor still calls every handler that matched
+  Trie trie;
+  modified = &trie;
+  CHECK(trie.add("a/+", 1));
+  CHECK(trie.add("a/+", 2));
+  CHECK(trie.add("a/b", 4));
+  called = 0;
+  size_t n = trie.match("a/b", 3, [](const int& h, void*) { called += h; modified->removeAll("a/+"); }, NULL);
+  CHECK(n == 3);
+  CHECK(called == 7);
+  CHECK(matches(trie, "a/b") == 4);
+
+  // A handler subscribing during delivery, growing the arrays, while a
+  // second handler matches the same topic
+  trie.clear();
+  CHECK(trie.add("x/#", 1));
+  CHECK(trie.add("x/y", 2));
+  called = 0;
+  n = trie.match("x/y", 3, [](const int& h, void*) {
+    called += h;
+    char filter[32];
+    for (int i = 0; i < 100; ++i) {
+      snprintf(filter, sizeof(filter), "x/y/%d", i);
+      modified->add(filter, 8);
+    }
+    modified->add("x/y", 16);
+  }, NULL);
+  CHECK(n == 2);
+  CHECK(called == 3);
+  CHECK(matches(trie, "x/y") == 19);
+
+  // More matches than fit on the stack, a visitor clearing the trie
+  trie.clear();
+  for (int i = 0; i < 20; ++i) {
+    CHECK(trie.add("m/+", 1 << i));
+  }
+  called = 0;
+  n = trie.match("m/n", 3, [](const int& h, void*) { called += h; modified->clear(); }, NULL);
+  CHECK(n == 20);
+  CHECK(called == (1 << 20) - 1);
+  CHECK(matches(trie, "m/n") == 0);
+}
+
+int main()
+{
+  testExact();
+  testWildcards();
+  testHandlers();
+  testInvalid();
+  testMany();
+  testModify();
+  return TEST_RESULT();
+}
@@ -0,0 +1,63 @@
+/*
+ * UtcClock: time derived from millis(), including millis() wrapping around
+ * between set() and now().
+ */
+
+#include "Test.h"
+#include "Arduino.h"
+#include "aws/DateTime.h"
+
+static const uint32_t EPOCH = 1494246658;
+
+/* Make millis() return now from here on */
+static void setMillis(uint32_t now)
+{
+  hostSetMillisOffset(0);
+  hostSetMillisOffset(now - (uint32_t) millis());
+}
+
+static void testNow()
+{
+  hostSetMillisOffset(0);
+  UtcClock clock;
+  CHECK(!clock.isSet());
+  CHECK(clock.now() == 0);
+
+  clock.set(EPOCH, 500);
+  CHECK(clock.isSet());
+  CHECK(clock.now() == EPOCH);
+  delay(600);
+  CHECK(clock.now() == EPOCH + 1);
+  CHECK(clock.sinceSet() >= 600);
+
+  clock.clear();
+  CHECK(!clock.isSet());
+  CHECK(clock.now() == 0);
+}
+
+static void testWrapAround()
+{
+  // millis() is 2 s short of wrapping around when the clock is set
+  setMillis(UINT32_MAX - 2000);
+  UtcClock clock;
+  clock.set(EPOCH);
+  CHECK(clock.now() == EPOCH);
+
+  // 3 s later millis() has wrapped around, without now() in between
+  setMillis(UINT32_MAX - 2000 + 3000);
+  CHECK((uint32_t) millis() < 2000);
+  CHECK(clock.now() == EPOCH + 3);
+  CHECK(clock.sinceSet() >= 3000 && clock.sinceSet() < 3100);
+
+  // and keeps counting from there
+  setMillis(UINT32_MAX - 2000 + 10000);
+  CHECK(clock.now() == EPOCH + 10);
+  hostSetMillisOffset(0);
+}
+
+int main()
+{
+  testNow();
+  testWrapAround();
+  return TEST_RESULT();
+}
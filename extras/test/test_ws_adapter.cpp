@@ -0,0 +1,289 @@
+/*
+ * AWSWebSocketClientAdapter and PacketFilter against the WebSocketsClient
+ * stand-in: MQTT packets split over several websocket frames, read as a
+ * block, byte by byte, with backpressure and through the packet filter,
+ * which takes PUBACKs and PUBLISHes for many filters side by side.
+ */
+
+#include <string>
+#include <vector>
+
+
+#include "Test.h"
+#include "mqtt/PacketFilter.h"
+#include "ws/WebSocketClientAdapter.h"
+
+class TestParams : public WebSocketParams
+{
+  public:
+    char* getHost() { return (char*) "localhost"; }
+    unsigned int getPort() { return 443; }
+    char* getPath() { return (char*) "/mqtt"; }
+    char* getFingerprint() { return (char*) ""; }
+    char* getProtocol() { return (char*) "mqtt"; }
+    bool useSsl() { return true; }
+};
+
+static TestParams params;
+
+// PUBLISH of "hi" to "a/b" at QoS 0
+static const uint8_t PUBLISH[] = { 0x30, 0x07, 0x00, 0x03, 'a', '/', 'b', 'h', 'i' };
+
+static WebSocketsClient* connect(AWSWebSocketClientAdapter& adapter)
+{
+  WebSocketsClient* ws = WebSocketsClient::hostLast;
+  CHECK(adapter.connect("localhost", 443));
+  return ws;
+}
+
+static void testSplitRead()
+{
+  AWSWebSocketClientAdapter adapter(params);
+  WebSocketsClient* ws = connect(adapter);
+
+  ws->hostQueueFrame(PUBLISH, 4);
+  ws->hostQueueFrame(PUBLISH + 4, sizeof(PUBLISH) - 4);
+
+  // Like Paho: wait for data, then read the packet as a block
+  CHECK(adapter.available() > 0);
+  uint8_t buf[sizeof(PUBLISH)];
+  CHECK(adapter.read(buf, sizeof(buf)) == (int) sizeof(buf));
+  CHECK(memcmp(buf, PUBLISH, sizeof(PUBLISH)) == 0);
+  CHECK(adapter.available() == 0);
+}
+
+static void testSplitBytewise()
+{
+  AWSWebSocketClientAdapter adapter(params);
+  WebSocketsClient* ws = connect(adapter);
+
+  ws->hostQueueFrame(PUBLISH, 2);
+  ws->hostQueueFrame(PUBLISH + 2, sizeof(PUBLISH) - 2);
+
+  // Like Stream::readBytes(), which reads byte by byte without available()
+  CHECK(adapter.available() > 0);
+  for (size_t i = 0; i < sizeof(PUBLISH); ++i) {
+    CHECK(adapter.read() == PUBLISH[i]);
+  }
+  CHECK(adapter.read() == -1);
+}
+
+static void testBackpressure()
+{
+  // Room for one frame at a time
+  AWSWebSocketClientAdapter adapter(params, 8);
+  adapter.setOverflowPolicy(AWSWebSocketClientAdapter::OVERFLOW_BACKPRESSURE, 5);
+  WebSocketsClient* ws = connect(adapter);
+
+  ws->hostQueueFrame(PUBLISH, 5);
+  ws->hostQueueFrame(PUBLISH + 5, sizeof(PUBLISH) - 5);
+
+  // The second frame is held back until the first one is read
+  uint8_t buf[sizeof(PUBLISH)];
+  size_t got = 0;
+  for (int i = 0; i < 10 && got < sizeof(buf); ++i) {
+    got += adapter.read(buf + got, sizeof(buf) - got);
+  }
+  CHECK(got == sizeof(PUBLISH));
+  CHECK(memcmp(buf, PUBLISH, sizeof(PUBLISH)) == 0);
+  CHECK(adapter.getBufferStats().droppedFrames == 0);
+}
+
+static unsigned short claimed;
+
+static bool claim(unsigned short id, void*)
+{
+  claimed = id;
+  return id == 0x8001;
+}
+
+static void noPublish(uint8_t*, size_t, size_t, void*)
+{
+  CHECK(false);
+}
+
+static void testSplitPuback()
+{
+  AWSWebSocketClientAdapter adapter(params);
+  PacketFilter filter(adapter, claim, noPublish, NULL);
+  WebSocketsClient* ws = connect(adapter);
+
+  // A PUBACK in two frames, then a PINGRESP
+  static const uint8_t puback[] = { 0x40, 0x02, 0x80, 0x01 };
+  static const uint8_t pingresp[] = { 0xd0, 0x00 };
+  ws->hostQueueFrame(puback, 2);
+  ws->hostQueueFrame(puback + 2, 2);
+  ws->hostQueueFrame(pingresp, 2);
+
+  // The reader only sees the PINGRESP
+  claimed = 0;
+  int n = 0;
+  for (int i = 0; i < 10 && n == 0; ++i) {
+    n = filter.available();
+  }
+  CHECK(claimed == 0x8001);
+  CHECK(n == 2);
+  CHECK(filter.read() == 0xd0);
+  CHECK(filter.read() == 0x00);
+}
+
+// What a filter's publish callback got
+struct Received
+{
+  PacketFilter* filter;
+  std::vector<std::string> packets;
+  std::vector<size_t> totals;
+};
+
+static bool noPuback(unsigned short, void*)
+{
+  return false;
+}
+
+static void collect(uint8_t* packet, size_t len, size_t total, void* arg)
+{
+  Received* r = (Received*) arg;
+  r->packets.push_back(std::string((const char*) packet, len));
+  r->totals.push_back(total);
+}
+
+// QoS 1 PUBLISH of payload to "t/<n>" with packet identifier n
+static std::string publishTo(int n, const std::string& payload)
+{
+  std::string topic = "t/" + std::to_string(n);
+  std::string p;
+  p += (char) 0x32;
+  p += (char) (2 + topic.size() + 2 + payload.size());
+  p += (char) 0;
+  p += (char) topic.size();
+  p += topic;
+  p += (char) (n >> 8);
+  p += (char) (n & 0xff);
+  p += payload;
+  return p;
+}
+
+static void testManyFilters()
+{
+  // Far more than a fixed set of handler functions would allow
+  static const int N = 100;
+  std::vector<AWSWebSocketClientAdapter*> adapters;
+  std::vector<PacketFilter*> filters;
+  std::vector<Received> received(N);
+  std::vector<WebSocketsClient*> sockets;
+  for (int i = 0; i < N; ++i) {
+    adapters.push_back(new AWSWebSocketClientAdapter(params));
+    filters.push_back(new PacketFilter(*adapters[i], noPuback, collect, &received[i]));
+    received[i].filter = filters[i];
+    sockets.push_back(connect(*adapters[i]));
+  }
+
+  // Each gets its own PUBLISH split over two frames, then a PINGRESP
+  static const uint8_t pingresp[] = { 0xd0, 0x00 };
+  for (int i = 0; i < N; ++i) {
+    std::string p = publishTo(i, "payload " + std::to_string(i));
+    sockets[i]->hostQueueFrame((const uint8_t*) p.data(), 3);
+    sockets[i]->hostQueueFrame((const uint8_t*) p.data() + 3, p.size() - 3);
+    sockets[i]->hostQueueFrame(pingresp, 2);
+  }
+
+  // Polled in turns, like the yield() of several clients
+  for (int round = 0; round < 10; ++round) {
+    for (int i = 0; i < N; ++i) {
+      filters[i]->available();
+    }
+  }
+  for (int i = 0; i < N; ++i) {
+    std::string p = publishTo(i, "payload " + std::to_string(i));
+    CHECK(received[i].packets.size() == 1);
+    if (received[i].packets.size() == 1) {
+      CHECK(received[i].packets[0] == p);
+      CHECK(received[i].totals[0] == p.size());
+    }
+    // The reader only sees the PINGRESP
+    CHECK(filters[i]->available() == 2);
+    CHECK(filters[i]->read() == 0xd0);
+  }
+
+  for (int i = 0; i < N; ++i) {
+    delete filters[i];
+    delete adapters[i];
+  }
+}
+
+static void testOversizePublish()
+{
+  AWSWebSocketClientAdapter adapter(params);
+  Received received;
+  PacketFilter filter(adapter, noPuback, collect, &received, 16);
+  WebSocketsClient* ws = connect(adapter);
+
+  std::string large = publishTo(1, std::string(100, 'x'));
+  std::string small = publishTo(2, "y");
+  ws->hostQueueFrame((const uint8_t*) large.data(), 40);
+  ws->hostQueueFrame((const uint8_t*) large.data() + 40, large.size() - 40);
+  ws->hostQueueFrame((const uint8_t*) small.data(), small.size());
+
+  for (int i = 0; i < 10; ++i) {
+    filter.available();
+  }
+  // The large one is cut to the buffer, the rest skipped
+  CHECK(received.packets.size() == 2);
+  if (received.packets.size() == 2) {
+    CHECK(received.packets[0] == large.substr(0, 16));
+    CHECK(received.totals[0] == large.size());
+    CHECK(received.packets[1] == small);
+  }
+  CHECK(filter.available() == 0);
+}
+
+// Reads through the filter from the callback, as a handler that publishes
+// and waits for the reply does
+static void readAgain(uint8_t* packet, size_t len, size_t total, void* arg)
+{
+  Received* r = (Received*) arg;
+  collect(packet, len, total, arg);
+  if (r->packets.size() == 1) {
+    for (int i = 0; i < 10 && r->packets.size() < 2; ++i) {
+      r->filter->available();
+    }
+    // The first packet is still intact
+    CHECK(std::string((const char*) packet, len) == r->packets[0]);
+  }
+}
+
+static void testNestedPublish()
+{
+  AWSWebSocketClientAdapter adapter(params);
+  Received received;
+  PacketFilter filter(adapter, noPuback, readAgain, &received);
+  received.filter = &filter;
+  WebSocketsClient* ws = connect(adapter);
+
+  std::string first = publishTo(1, "first");
+  std::string second = publishTo(2, "second");
+  ws->hostQueueFrame((const uint8_t*) first.data(), first.size());
+  ws->hostQueueFrame((const uint8_t*) second.data(), 4);
+  ws->hostQueueFrame((const uint8_t*) second.data() + 4, second.size() - 4);
+
+  for (int i = 0; i < 10 && received.packets.size() < 2; ++i) {
+    filter.available();
+  }
+  CHECK(received.packets.size() == 2);
+  if (received.packets.size() == 2) {
+    CHECK(received.packets[0] == first);
+    CHECK(received.packets[1] == second);
+  }
+}
+
+int main()
+{
+  testSplitRead();
+  testSplitBytewise();
+  testBackpressure();
+  testSplitPuback();
+  testManyFilters();
+  testOversizePublish();
+  testNestedPublish();
+  return TEST_RESULT();
+}
@@ -5,6 +5,8 @@
 #include "mqtt/MqttClient.h"
 #include "aws/AwsIotSigv4.h"
 #include "aws/ESP8266DateTimeProvider.h"
+#include "aws/ESP8266UdpTransport.h"
+#include "aws/SntpDateTimeProvider.h"
 #include "aws-sdk-arduino/DeviceIndependentInterfaces.h"
 #include "ws/CircularByteBuffer.h"
 #include "ws/WebSocketClientAdapter.h"
@@ -28,8 +28,8 @@ public:
     virtual bool syncTakesArg(void) = 0;
     /* Called if AWS Service reports in accurate time. Sets the provider to
      * current time. If syncTakesArg() returns true, this argument takes the
-     * current GMT date and time in yyyyMMddHHmmss format. Else, the nput value
-     * is ignored and may be null. */
+     * current GMT date and time in yyyyMMddHHmmss format, or null if AWS did
+     * not report it. Else, the nput value is ignored and may be null. */
     virtual void sync(const char* dateTime) = 0;
 };
 
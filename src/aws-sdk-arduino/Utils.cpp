@@ -14,6 +14,7 @@
 #include <stdint.h>
 #include "jsmn.h"
 #include "sha256.h"
+#include "hmacsha256.h"
 
 /* Constants for base64Encode. */
 static const char ENCODE_CHARS[] =
@@ -25,9 +26,6 @@ static const char HTTP_STATUS_CODE_PREFIX[] = "HTTP/1.1 ";
 static const int HTTP_STATUS_CODE_LEN = 3;
 
 /* Constants for hmacSha256. */
-static const int BLOCK_SIZE = 64;
-static const char OPAD = 0x5c;
-static const char IPAD = 0x36;
 const int SHA256_DEC_HASH_LEN = 32;
 
 char *base64Encode(const char *toEncode) {
@@ -330,7 +328,8 @@ char* getTimeFromInvalidSignatureMessage(const char* message) {
     for (int i = 0; i < messageLen; i++) {
         /* If an opening parenthesis is found, copy the following 15
          * characters, excluding the 9th character which is a 'T'.*/
-        if (message[i] == '(') {
+        /* Bounds check added to original source. */
+        if (message[i] == '(' && i + 15 < messageLen) {
             char* time = new char[15]();
             sprintf(time, "%.8s%.6s", message + i + 1, message + i + 10);
             return time;
@@ -341,51 +340,8 @@ char* getTimeFromInvalidSignatureMessage(const char* message) {
 
 char* hmacSha256(const char* key, int keyLen, const char* message,
         int messageLen) {
-    SHA256* sha256 = new SHA256();
-    /* The corrected key should be BLOCK_SIZE long. */
-    char* correctedKey = new char[BLOCK_SIZE + 1]();
-    /* If the key is greater than BLOCK_SIZE long, copy over its sha256 hash of
-     * SHA256_DEC_HASH_LEN, leaving 0-padding to fill the entire BLOCK_SIZE. */
-    if ((int) keyLen > BLOCK_SIZE) {
-        sha256->reset();
-        sha256->add(key, keyLen);
-        char* hashedKey = sha256->getHashDec();
-        memcpy(correctedKey, hashedKey, SHA256_DEC_HASH_LEN);
-        delete[] hashedKey;
-    }
-    /* if the key is less than BLOCK_SIZE long, simply copy it over, leaving
-     * 0-padding to fill the entire BLOCK_SIZE. */
-    else {
-        memcpy(correctedKey, key, keyLen);
-    }
-
-    /* Using an exclusive or with these OPAD and IPAD values to create the
-     * iPadded and oPadded values specified by the HMAC algorithm. */
-    char* oPadded = new char[BLOCK_SIZE + 1]();
-    char* iPadded = new char[BLOCK_SIZE + 1]();
-    for (int i = 0; i < BLOCK_SIZE; i++) {
-        oPadded[i] = correctedKey[i] ^ OPAD;
-        iPadded[i] = correctedKey[i] ^ IPAD;
-    }
-
-    delete[] correctedKey;
-
-    /* Create the inner hash with the concatenation of iPadded and message. */
-    sha256->reset();
-    sha256->add(iPadded, BLOCK_SIZE);
-    delete[] iPadded;
-    sha256->add(message, messageLen);
-    char* innerHash = sha256->getHashDec();
-
-    /* Create the outer hash with the concatenation of oPadded and
-     * innerhash. */
-    sha256->reset();
-    sha256->add(oPadded, BLOCK_SIZE);
-    delete[] oPadded;
-    sha256->add(innerHash, SHA256_DEC_HASH_LEN);
-    delete[] innerHash;
-    char* final = sha256->getHashDec();
-    delete sha256;
+    HmacSha256 hmac(key, keyLen);
+    char* final = new char[SHA256_DEC_HASH_LEN + 1]();
+    hmac.mac(message, messageLen, (uint8_t*) final);
     return final;
 }
-
@@ -70,7 +70,9 @@ char* jsmnGetVal(const char* key, const char* json, jsmntok_t* tokens,
  * the first opening parenthesis. (e.g. "...(20140721T184435Z ..." )*/
 char* getTimeFromInvalidSignatureMessage(const char* message);
 
-/* Apply hmac to the key and message. */
+/* Apply hmac to the key and message. Returned array of SHA256_DEC_HASH_LEN
+ * bytes must be deleted by caller. Use HmacSha256 in hmacsha256.h to avoid the
+ * allocation or to reuse a key for several messages. */
 char* hmacSha256(const char* key, int keyLen, const char* message,
         int messageLen);
 
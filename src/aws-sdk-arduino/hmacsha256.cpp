@@ -0,0 +1,79 @@
+/*
+ * hmacsha256.cpp
+ *
+ *  See hmacsha256.h for description.
+ */
+
+#include "hmacsha256.h"
+#include <string.h>
+
+static const uint8_t OPAD = 0x5c;
+static const uint8_t IPAD = 0x36;
+
+HmacSha256::HmacSha256() {
+}
+
+HmacSha256::HmacSha256(const void* key, size_t keyLen) {
+    setKey(key, keyLen);
+}
+
+void HmacSha256::setKey(const void* key, size_t keyLen) {
+    /* The corrected key is BlockSize bytes long. Keys longer than BlockSize are
+     * replaced by their hash, shorter keys are 0-padded. */
+    uint8_t correctedKey[BlockSize];
+    memset(correctedKey, 0, BlockSize);
+    if (keyLen > BlockSize) {
+        SHA256 sha256;
+        sha256.add(key, keyLen);
+        sha256.finalize(correctedKey);
+    } else {
+        memcpy(correctedKey, key, keyLen);
+    }
+
+    uint8_t padded[BlockSize];
+    for (int i = 0; i < BlockSize; i++) {
+        padded[i] = correctedKey[i] ^ IPAD;
+    }
+    m_innerKeyed.reset();
+    m_innerKeyed.add(padded, BlockSize);
+
+    for (int i = 0; i < BlockSize; i++) {
+        padded[i] = correctedKey[i] ^ OPAD;
+    }
+    m_outerKeyed.reset();
+    m_outerKeyed.add(padded, BlockSize);
+
+    /* Don't leave key material on the stack. */
+    memset(correctedKey, 0, BlockSize);
+    memset(padded, 0, BlockSize);
+
+    reset();
+}
+
+void HmacSha256::reset() {
+    m_inner = m_innerKeyed;
+}
+
+void HmacSha256::add(const void* data, size_t numBytes) {
+    m_inner.add(data, numBytes);
+}
+
+void HmacSha256::finalize(uint8_t* out) {
+    uint8_t innerHash[HashBytes];
+    m_inner.finalize(innerHash);
+
+    SHA256 outer = m_outerKeyed;
+    outer.add(innerHash, HashBytes);
+    outer.finalize(out);
+}
+
+void HmacSha256::mac(const void* message, size_t messageLen, uint8_t* out) {
+    reset();
+    add(message, messageLen);
+    finalize(out);
+}
+
+void HmacSha256::getMidstates(uint32_t inner[8], uint32_t outer[8]) const {
+    m_innerKeyed.getState(inner);
+    m_outerKeyed.getState(outer);
+}
@@ -0,0 +1,79 @@
+/*
+ * hmacsha256.h
+ *
+ *  HMAC-SHA256 (RFC 2104) context that works on caller provided buffers.
+ */
+
+#ifndef HMACSHA256_H_
+#define HMACSHA256_H_
+
+#pragma once
+
+#include <stdint.h>
+#include "stddef.h"
+#include "sha256.h"
+
+/* Compute HMAC-SHA256 without heap allocations.
+ *
+ * setKey() absorbs the ipad and opad key blocks once and keeps the resulting
+ * SHA256 states. Every following MAC starts from these saved states, which
+ * saves two compression function calls per message compared to hmacSha256()
+ * in Utils.h. The same key can thus be reused for any number of messages.
+ *
+ * Usage:
+ *  HmacSha256 hmac(key, keyLen);
+ *  uint8_t mac[HmacSha256::HashBytes];
+ *  hmac.mac(message, messageLen, mac);
+ *
+ *  // or in a streaming fashion:
+ *  hmac.reset();
+ *  while (more data available)
+ *    hmac.add(pointer to fresh data, number of new bytes);
+ *  hmac.finalize(mac);
+ */
+class HmacSha256
+{
+public:
+    enum {
+        BlockSize = 64, HashBytes = 32
+    };
+
+    /* Create a context without key. setKey() must be called before use. */
+    HmacSha256();
+
+    /* Create a context and set key, see setKey(). */
+    HmacSha256(const void* key, size_t keyLen);
+
+    /* Set the key and precompute the inner and outer midstates. Keys longer
+     * than BlockSize are hashed first, as specified by RFC 2104. */
+    void setKey(const void* key, size_t keyLen);
+
+    /* Restart the inner hash for a new message, using the current key. */
+    void reset();
+
+    /* Add message data to the inner hash. */
+    void add(const void* data, size_t numBytes);
+
+    /* Write the MAC of the message added since the last reset() to out, which
+     * must hold HashBytes bytes. Call reset() before adding a new message. */
+    void finalize(uint8_t* out);
+
+    /* Compute the MAC of a single message, i.e. reset(), add() and
+     * finalize(). */
+    void mac(const void* message, size_t messageLen, uint8_t* out);
+
+    /* Copy the SHA256 states after absorbing key ^ ipad and key ^ opad, i.e.
+     * the first BlockSize bytes of the inner and outer hash. Used by the
+     * multi-buffer engine in sha256mb.h. */
+    void getMidstates(uint32_t inner[8], uint32_t outer[8]) const;
+
+private:
+    /* SHA256 state after absorbing key ^ ipad */
+    SHA256 m_innerKeyed;
+    /* SHA256 state after absorbing key ^ opad */
+    SHA256 m_outerKeyed;
+    /* Inner hash of the message in progress */
+    SHA256 m_inner;
+};
+
+#endif /* HMACSHA256_H_ */
@@ -6,9 +6,11 @@
 
 #include "sha256.h"
 
+#include <string.h>
+
 /* These lines have been discarded from the original source code. endian.h is
- * not necessarilly included on the devices that will use this SDK. Little
- * Endian is assumed instead. */
+ * not necessarilly included on the devices that will use this SDK. Input is
+ * read byte by byte as big endian instead. */
 // // big endian architectures need #define __BYTE_ORDER __BIG_ENDIAN
 // #ifndef _MSC_VER
 // #include <endian.h>
@@ -34,24 +36,26 @@ void SHA256::reset() {
     m_hash[7] = 0x5be0cd19;
 }
 
+/// copy the current state
+/* This function added to original source. */
+void SHA256::getState(uint32_t out[8]) const {
+    memcpy(out, m_hash, sizeof(m_hash));
+}
+
 namespace {
 inline uint32_t rotate(uint32_t a, uint32_t c) {
     return (a >> c) | (a << (32 - c));
 }
 
-inline uint32_t swap(uint32_t x) {
-#if defined(__GNUC__) || defined(__clang__)
-    return __builtin_bswap32(x);
-#endif
-#ifdef MSC_VER
-    return _byteswap_ulong(x);
-#endif
-
-    return (x >> 24) | ((x >> 8) & 0x0000FF00) | ((x << 8) & 0x00FF0000)
-            | (x << 24);
+/* Modified from original source code. Reading bytes as big endian instead of
+ * swapping 32-bit words, so input needs no alignment and any byte order
+ * works. */
+inline uint32_t loadBigEndian(const uint8_t* p) {
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+            | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
 }
 
-// mix functions for processBlock()
+// mix functions for processBlockPortable()
 inline uint32_t f1(uint32_t e, uint32_t f, uint32_t g) {
     uint32_t term1 = rotate(e, 6) ^ rotate(e, 11) ^ rotate(e, 25);
     uint32_t term2 = (e & f) ^ (~e & g); //(g ^ (e & (f ^ g)))
@@ -63,31 +67,26 @@ inline uint32_t f2(uint32_t a, uint32_t b, uint32_t c) {
     uint32_t term2 = ((a | b) & c) | (a & b); //(a & (b ^ c)) ^ (b & c);
     return term1 + term2;
 }
-}
 
 /// process 64 bytes
-void SHA256::processBlock(const void* data) {
+/* Modified from original source code. Free function working on a given state,
+ * used by the portable backend. */
+void processBlockPortable(uint32_t* hash, const uint8_t* data) {
     // get last hash
-    uint32_t a = m_hash[0];
-    uint32_t b = m_hash[1];
-    uint32_t c = m_hash[2];
-    uint32_t d = m_hash[3];
-    uint32_t e = m_hash[4];
-    uint32_t f = m_hash[5];
-    uint32_t g = m_hash[6];
-    uint32_t h = m_hash[7];
-
-    // data represented as 16x 32-bit words
-    const uint32_t* input = (uint32_t*) data;
-    // convert to big endian
+    uint32_t a = hash[0];
+    uint32_t b = hash[1];
+    uint32_t c = hash[2];
+    uint32_t d = hash[3];
+    uint32_t e = hash[4];
+    uint32_t f = hash[5];
+    uint32_t g = hash[6];
+    uint32_t h = hash[7];
+
+    // data represented as 16x 32-bit big endian words
     uint32_t words[64];
     int i;
     for (i = 0; i < 16; i++)
-#if defined(__BYTE_ORDER) && (__BYTE_ORDER != 0) && (__BYTE_ORDER == __BIG_ENDIAN)
-        words[i] = input[i];
-#else
-        words[i] = swap(input[i]);
-#endif
+        words[i] = loadBigEndian(data + 4 * i);
 
     uint32_t x, y; // temporaries
 
@@ -412,25 +411,102 @@ void SHA256::processBlock(const void* data) {
     a = x + y;
 
     // update hash
-    m_hash[0] += a;
-    m_hash[1] += b;
-    m_hash[2] += c;
-    m_hash[3] += d;
-    m_hash[4] += e;
-    m_hash[5] += f;
-    m_hash[6] += g;
-    m_hash[7] += h;
+    hash[0] += a;
+    hash[1] += b;
+    hash[2] += c;
+    hash[3] += d;
+    hash[4] += e;
+    hash[5] += f;
+    hash[6] += g;
+    hash[7] += h;
+}
+
+void compressPortable(uint32_t state[8], const uint8_t* data, size_t numBlocks) {
+    for (; numBlocks > 0; numBlocks--, data += 64)
+        processBlockPortable(state, data);
+}
+
+bool alwaysAvailable() {
+    return true;
+}
+
+const SHA256Backend PORTABLE_BACKEND = { "portable", compressPortable, alwaysAvailable };
+}
+
+#if defined(SHA256_HAVE_SHANI)
+extern const SHA256Backend SHA256_SHANI_BACKEND;
+#endif
+#if defined(SHA256_HAVE_BEARSSL)
+extern const SHA256Backend SHA256_BEARSSL_BACKEND;
+#endif
+
+/* Added to original source. Backend shared by all SHA256 objects, selected on
+ * first use. */
+static const SHA256Backend* s_backend = 0;
+
+const SHA256Backend* SHA256::portableBackend() {
+    return &PORTABLE_BACKEND;
+}
+
+const SHA256Backend* SHA256::shaniBackend() {
+#if defined(SHA256_HAVE_SHANI)
+    return &SHA256_SHANI_BACKEND;
+#else
+    return 0;
+#endif
+}
+
+const SHA256Backend* SHA256::bearsslBackend() {
+#if defined(SHA256_HAVE_BEARSSL)
+    return &SHA256_BEARSSL_BACKEND;
+#else
+    return 0;
+#endif
+}
+
+bool SHA256::setBackend(const SHA256Backend* backend) {
+    if (backend == 0) {
+        // best first
+        const SHA256Backend* candidates[] = { shaniBackend(), bearsslBackend() };
+        backend = portableBackend();
+        for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+            if (candidates[i] != 0 && candidates[i]->isAvailable()) {
+                backend = candidates[i];
+                break;
+            }
+        }
+    } else if (!backend->isAvailable()) {
+        return false;
+    }
+    s_backend = backend;
+    return true;
+}
+
+const SHA256Backend* SHA256::getBackend() {
+    if (s_backend == 0)
+        setBackend(0);
+    return s_backend;
+}
+
+/// process 64 bytes
+void SHA256::processBlock(const void* data) {
+    getBackend()->compress(m_hash, (const uint8_t*) data, 1);
 }
 
 /// add arbitrary number of bytes
+/* Modified from original source code. Copying with memcpy instead of byte by
+ * byte. */
 void SHA256::add(const void* data, size_t numBytes) {
     const uint8_t* current = (const uint8_t*) data;
 
     if (m_bufferSize > 0) {
-        while (numBytes > 0 && m_bufferSize < BlockSize) {
-            m_buffer[m_bufferSize++] = *current++;
-            numBytes--;
-        }
+        size_t fill = BlockSize - m_bufferSize;
+        if (fill > numBytes)
+            fill = numBytes;
+        memcpy(m_buffer + m_bufferSize, current, fill);
+        m_bufferSize += fill;
+        current += fill;
+        numBytes -= fill;
     }
 
     // full buffer
@@ -445,18 +521,19 @@ void SHA256::add(const void* data, size_t numBytes) {
         return;
 
     // process full blocks
-    while (numBytes >= BlockSize) {
-        processBlock(current);
-        current += BlockSize;
-        m_numBytes += BlockSize;
-        numBytes -= BlockSize;
+    /* Modified from original source code. All full blocks are passed to the
+     * backend at once. */
+    if (numBytes >= BlockSize) {
+        size_t numBlocks = numBytes / BlockSize;
+        getBackend()->compress(m_hash, current, numBlocks);
+        current += numBlocks * BlockSize;
+        m_numBytes += numBlocks * BlockSize;
+        numBytes -= numBlocks * BlockSize;
     }
 
     // keep remaining bytes in buffer
-    while (numBytes > 0) {
-        m_buffer[m_bufferSize++] = *current++;
-        numBytes--;
-    }
+    memcpy(m_buffer, current, numBytes);
+    m_bufferSize = numBytes;
 }
 
 /// process final block, less than 64 bytes
@@ -523,70 +600,65 @@ void SHA256::processBuffer() {
         processBlock(extra);
 }
 
-/// return latest hash as 16 hex characters
-/* Modified from original source code. Using char* instead of string. */
-char* SHA256::getHash() {
-    // convert hash to string
-    static const char dec2hex[16 + 1] = "0123456789abcdef";
-
-    // save old hash if buffer is partially filled
-    uint32_t oldHash[HashValues];
-    for (int i = 0; i < HashValues; i++)
-        oldHash[i] = m_hash[i];
-
+/* This function added to original source. */
+/// finish hashing and write the raw hash (not as hex) to out
+void SHA256::finalize(uint8_t out[32]) {
     // process remaining bytes
     processBuffer();
 
-    // create hash string
-    /* Modified from original source code. Creating char* instead of string. */
-    char* hashBuffer = new char[HashValues * 8 + 1]();
     size_t offset = 0;
     for (int i = 0; i < HashValues; i++) {
-        hashBuffer[offset++] = dec2hex[(m_hash[i] >> 28) & 15];
-        hashBuffer[offset++] = dec2hex[(m_hash[i] >> 24) & 15];
-        hashBuffer[offset++] = dec2hex[(m_hash[i] >> 20) & 15];
-        hashBuffer[offset++] = dec2hex[(m_hash[i] >> 16) & 15];
-        hashBuffer[offset++] = dec2hex[(m_hash[i] >> 12) & 15];
-        hashBuffer[offset++] = dec2hex[(m_hash[i] >> 8) & 15];
-        hashBuffer[offset++] = dec2hex[(m_hash[i] >> 4) & 15];
-        hashBuffer[offset++] = dec2hex[m_hash[i] & 15];
-
-        // restore old hash
-        m_hash[i] = oldHash[i];
+        out[offset++] = (m_hash[i] >> 24) & 0xff;
+        out[offset++] = (m_hash[i] >> 16) & 0xff;
+        out[offset++] = (m_hash[i] >> 8) & 0xff;
+        out[offset++] = m_hash[i] & 0xff;
     }
-    // zero-terminated string
-    hashBuffer[offset] = 0;
-
-    return hashBuffer;
 }
 
-/* This function added to original source. It is a modified version of
- * getHash() from above. */
-/// return latest hash raw (not as hex)
-char* SHA256::getHashDec() {
-    // save old hash if buffer is partially filled
-    uint32_t oldHash[HashValues];
-    for (int i = 0; i < HashValues; i++)
-        oldHash[i] = m_hash[i];
+/* This function added to original source. */
+/// finish hashing and write the hash as zero-terminated hex string to out
+void SHA256::finalizeHex(char out[65]) {
+    // convert hash to string
+    static const char dec2hex[16 + 1] = "0123456789abcdef";
 
     // process remaining bytes
     processBuffer();
 
-    // create hash string
-    /* Modified from original source code. Creating char* instead of string. */
-    char* hashBuffer = new char[HashValues * 4 + 1]();
     size_t offset = 0;
     for (int i = 0; i < HashValues; i++) {
-        hashBuffer[offset++] = (m_hash[i] >> 24) & 0xff;
-        hashBuffer[offset++] = (m_hash[i] >> 16) & 0xff;
-        hashBuffer[offset++] = (m_hash[i] >> 8) & 0xff;
-        hashBuffer[offset++] = m_hash[i] & 0xff;
-        // restore old hash
-        m_hash[i] = oldHash[i];
+        out[offset++] = dec2hex[(m_hash[i] >> 28) & 15];
+        out[offset++] = dec2hex[(m_hash[i] >> 24) & 15];
+        out[offset++] = dec2hex[(m_hash[i] >> 20) & 15];
+        out[offset++] = dec2hex[(m_hash[i] >> 16) & 15];
+        out[offset++] = dec2hex[(m_hash[i] >> 12) & 15];
+        out[offset++] = dec2hex[(m_hash[i] >> 8) & 15];
+        out[offset++] = dec2hex[(m_hash[i] >> 4) & 15];
+        out[offset++] = dec2hex[m_hash[i] & 15];
     }
     // zero-terminated string
-    hashBuffer[offset] = 0;
+    out[offset] = 0;
+}
 
+/// return latest hash as 16 hex characters
+/* Modified from original source code. Using char* instead of string. Thin
+ * wrapper around finalizeHex(), working on a copy to keep this object
+ * usable. */
+char* SHA256::getHash() {
+    char* hashBuffer = new char[HashValues * 8 + 1];
+    SHA256 copy(*this);
+    copy.finalizeHex(hashBuffer);
+    return hashBuffer;
+}
+
+/* This function added to original source. Thin wrapper around finalize(),
+ * working on a copy to keep this object usable. */
+/// return latest hash raw (not as hex)
+char* SHA256::getHashDec() {
+    char* hashBuffer = new char[HashValues * 4 + 1];
+    SHA256 copy(*this);
+    copy.finalize((uint8_t*) hashBuffer);
+    // zero-terminated string
+    hashBuffer[HashValues * 4] = 0;
     return hashBuffer;
 }
 
@@ -27,6 +27,30 @@ typedef unsigned __int64 uint64_t;
 // This line added to original source code. defines size_t.
 #include "stddef.h"
 
+/* This struct added to original source. */
+/// SHA256 compression function backend, see SHA256::setBackend()
+struct SHA256Backend
+{
+    /// short name for reporting, e.g. "portable"
+    const char* name;
+    /// process numBlocks consecutive 64 byte blocks, updating state
+    void (*compress)(uint32_t state[8], const uint8_t* data, size_t numBlocks);
+    /// return true if the backend can be used on this machine
+    bool (*isAvailable)();
+};
+
+/* Compile-time backend selection, added to original source:
+ *  SHA256_NO_SHANI    don't build the x86 SHA extensions backend
+ *  SHA256_USE_BEARSSL build the BearSSL backend (e.g. from the ESP8266 core)
+ */
+#if !defined(SHA256_NO_SHANI) && (defined(__x86_64__) || defined(__i386__)) \
+        && (defined(__GNUC__) || defined(__clang__))
+#define SHA256_HAVE_SHANI 1
+#endif
+#if defined(SHA256_USE_BEARSSL)
+#define SHA256_HAVE_BEARSSL 1
+#endif
+
 /// compute SHA256 hash
 /** Usage:
  SHA256 sha256;
@@ -39,6 +63,11 @@ typedef unsigned __int64 uint64_t;
  while (more data available)
  sha256.add(pointer to fresh data, number of new bytes);
  std::string myHash3 = sha256.getHash();
+
+ // or without allocating:
+
+ char myHash4[65];
+ sha256.finalizeHex(myHash4);
  */
 class SHA256 //: public Hash
 {
@@ -56,17 +85,48 @@ public:
     /// add arbitrary number of bytes
     void add(const void* data, size_t numBytes);
 
+    /* This function added to original source. */
+    /// finish hashing and write the raw hash (not as hex) to out
+    /** Does not allocate. The object must be reset() before it is reused. */
+    void finalize(uint8_t out[32]);
+
+    /* This function added to original source. */
+    /// finish hashing and write the hash as zero-terminated hex string to out
+    /** Does not allocate. The object must be reset() before it is reused. */
+    void finalizeHex(char out[65]);
+
     /// return latest hash as 16 hex characters
-    /* Modified from original source code. Using char* instead of string. */
+    /* Modified from original source code. Using char* instead of string.
+     * Returned array must be deleted by caller. Prefer finalizeHex(). */
     char* getHash();
 
     /* This function added to original source. */
     /// return latest hash raw (not as hex)
+    /* Returned array must be deleted by caller. Prefer finalize(). */
     char* getHashDec();
 
     /// restart
     void reset();
 
+    /* This function added to original source. */
+    /// copy the current state, i.e. the midstate after all complete blocks
+    /** Only meaningful if a multiple of 64 bytes has been added so far. */
+    void getState(uint32_t out[8]) const;
+
+    /* These functions added to original source. */
+    /// select the compression backend for all SHA256 objects. 0 selects the
+    /// best available one, which is also the default. Returns false (and
+    /// keeps the current backend) if the backend is not available.
+    static bool setBackend(const SHA256Backend* backend);
+    /// return the backend in use
+    static const SHA256Backend* getBackend();
+    /// portable C++ backend, always available
+    static const SHA256Backend* portableBackend();
+    /// x86 SHA extensions backend, 0 if not built
+    static const SHA256Backend* shaniBackend();
+    /// BearSSL backend, 0 if not built
+    static const SHA256Backend* bearsslBackend();
+
 private:
     /// process 64 bytes
     void processBlock(const void* data);
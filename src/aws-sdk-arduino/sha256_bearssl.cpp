@@ -0,0 +1,40 @@
+// //////////////////////////////////////////////////////////
+// sha256_bearssl.cpp
+//
+// SHA256 compression function delegating to BearSSL, e.g. the copy shipped
+// with the ESP8266 Arduino core. Not part of the original sha256.cpp by
+// Stephan Brumme.
+//
+// Only built if SHA256_USE_BEARSSL is defined, see sha256.h. Uses the public
+// br_sha256_context only: the running state is loaded into the context and
+// whole blocks are fed to br_sha256_update(), which processes a block as
+// soon as it is complete.
+//
+
+#include "sha256.h"
+
+#if defined(SHA256_HAVE_BEARSSL)
+
+#include <string.h>
+#include <bearssl/bearssl_hash.h>
+
+namespace {
+
+/// process numBlocks 64 byte blocks
+void compressBearssl(uint32_t state[8], const uint8_t* data, size_t numBlocks) {
+    br_sha256_context ctx;
+    br_sha256_init(&ctx);
+    memcpy(ctx.val, state, sizeof(ctx.val));
+    br_sha256_update(&ctx, data, numBlocks * 64);
+    memcpy(state, ctx.val, sizeof(ctx.val));
+}
+
+bool bearsslAvailable() {
+    return true;
+}
+
+}
+
+extern const SHA256Backend SHA256_BEARSSL_BACKEND = { "bearssl", compressBearssl, bearsslAvailable };
+
+#endif
@@ -0,0 +1,103 @@
+// //////////////////////////////////////////////////////////
+// sha256_shani.cpp
+//
+// SHA256 compression function using the x86 SHA extensions (SHA-NI).
+// Not part of the original sha256.cpp by Stephan Brumme. Based on the
+// public domain reference by Intel and Jeffrey Walton.
+//
+// Only built on x86 with GCC or clang, see SHA256_HAVE_SHANI in sha256.h.
+// The instructions are enabled per function, so no special compiler flags
+// are needed. Availability is checked at run time with CPUID.
+//
+
+#include "sha256.h"
+
+#if defined(SHA256_HAVE_SHANI)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+namespace {
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/// process numBlocks 64 byte blocks
+__attribute__((target("sha,sse4.1,ssse3")))
+void compressShani(uint32_t state[8], const uint8_t* data, size_t numBlocks) {
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // state is kept as ABEF and CDGH, as expected by sha256rnds2
+    __m128i tmp = _mm_loadu_si128((const __m128i*) &state[0]);
+    __m128i state1 = _mm_loadu_si128((const __m128i*) &state[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);            // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);      // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);   // CDGH
+
+    for (; numBlocks > 0; numBlocks--, data += 64) {
+        __m128i abefSave = state0;
+        __m128i cdghSave = state1;
+
+        // message schedule, four words per register
+        __m128i w[4];
+        for (int i = 0; i < 4; i++)
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 16 * i)), MASK);
+
+        // 16 x 4 rounds
+        for (int i = 0; i < 16; i++) {
+            __m128i msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i*) &K[4 * i]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+            // words for rounds 4 * (i + 1) ...
+            if (i >= 3 && i <= 14) {
+                tmp = _mm_alignr_epi8(w[i & 3], w[(i + 3) & 3], 4);
+                w[(i + 1) & 3] = _mm_add_epi32(w[(i + 1) & 3], tmp);
+                w[(i + 1) & 3] = _mm_sha256msg2_epu32(w[(i + 1) & 3], w[i & 3]);
+            }
+
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+            // ... and first half of words for rounds 4 * (i + 3)
+            if (i >= 1 && i <= 12)
+                w[(i + 3) & 3] = _mm_sha256msg1_epu32(w[(i + 3) & 3], w[i & 3]);
+        }
+
+        state0 = _mm_add_epi32(state0, abefSave);
+        state1 = _mm_add_epi32(state1, cdghSave);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);         // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);      // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);   // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);      // ABEF
+    _mm_storeu_si128((__m128i*) &state[0], state0);
+    _mm_storeu_si128((__m128i*) &state[4], state1);
+}
+
+bool shaniAvailable() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    if (!(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+        return false;
+    if (__get_cpuid_max(0, 0) < 7)
+        return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1u << 29)) != 0; // SHA
+}
+
+}
+
+extern const SHA256Backend SHA256_SHANI_BACKEND = { "shani", compressShani, shaniAvailable };
+
+#endif
@@ -0,0 +1,319 @@
+/*
+ * sha256mb.cpp
+ *
+ *  See sha256mb.h for description.
+ */
+
+#include "sha256mb.h"
+#include <string.h>
+
+#if defined(SHA256MB_HAVE_SIMD)
+#include <chrono>
+#endif
+
+static const uint8_t OPAD = 0x5c;
+static const uint8_t IPAD = 0x36;
+
+/* Blocks per lane passed to the backend in one call by hashGroup() */
+static const size_t RUN_BLOCKS = 8;
+
+static const uint32_t IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static void compressScalar(uint32_t* const* states, const uint8_t* const* blocks, size_t numBlocks,
+                           size_t stride) {
+    const SHA256Backend* backend = SHA256::getBackend();
+    for (size_t n = 0; n < numBlocks; n++) {
+        backend->compress(states[0], blocks[n * stride], 1);
+    }
+}
+
+static bool alwaysAvailable() {
+    return true;
+}
+
+static const Sha256MbBackend SCALAR_BACKEND = { "scalar", 1, compressScalar, alwaysAvailable };
+
+#if defined(SHA256MB_HAVE_SIMD)
+extern const Sha256MbBackend SHA256MB_SSE2_BACKEND;
+extern const Sha256MbBackend SHA256MB_AVX2_BACKEND;
+#endif
+
+static const Sha256MbBackend* s_backend = 0;
+
+const Sha256MbBackend* Sha256Mb::scalarBackend() {
+    return &SCALAR_BACKEND;
+}
+
+const Sha256MbBackend* Sha256Mb::sse2Backend() {
+#if defined(SHA256MB_HAVE_SIMD)
+    return &SHA256MB_SSE2_BACKEND;
+#else
+    return 0;
+#endif
+}
+
+const Sha256MbBackend* Sha256Mb::avx2Backend() {
+#if defined(SHA256MB_HAVE_SIMD)
+    return &SHA256MB_AVX2_BACKEND;
+#else
+    return 0;
+#endif
+}
+
+bool Sha256Mb::setBackend(const Sha256MbBackend* backend) {
+    if (backend == 0) {
+        // best first. The SHA extensions beat any number of SIMD lanes, one
+        // message at a time.
+        const Sha256MbBackend* candidates[] = { avx2Backend(), sse2Backend() };
+        backend = scalarBackend();
+        if (SHA256::getBackend() == SHA256::shaniBackend())
+            candidates[0] = candidates[1] = 0;
+        for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+            if (candidates[i] != 0 && candidates[i]->isAvailable()) {
+                backend = candidates[i];
+                break;
+            }
+        }
+    } else if (!backend->isAvailable()) {
+        return false;
+    }
+    s_backend = backend;
+    return true;
+}
+
+const Sha256MbBackend* Sha256Mb::getBackend() {
+    if (s_backend == 0)
+        setBackend(0);
+    return s_backend;
+}
+
+#if defined(SHA256MB_HAVE_SIMD)
+/* Fastest of a few runs of iterations calls, in nanoseconds */
+template <typename F>
+static double fastestRun(F f, int iterations) {
+    double best = 0;
+    for (int run = 0; run < 3; run++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            f();
+        }
+        std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+        if (run == 0 || d.count() < best) {
+            best = d.count();
+        }
+    }
+    return best;
+}
+#endif
+
+bool Sha256Mb::batchIsFaster() {
+    static const Sha256MbBackend* measuredBackend = 0;
+    static const SHA256Backend* measuredSha256 = 0;
+    static bool faster = false;
+
+    const Sha256MbBackend* backend = getBackend();
+    if (backend->lanes == 1) {
+        return false;
+    }
+#if defined(SHA256MB_HAVE_SIMD)
+    if (backend == measuredBackend && SHA256::getBackend() == measuredSha256) {
+        return faster;
+    }
+
+    // about the size of a canonical request, 4 blocks
+    static const size_t LEN = 200;
+    uint8_t data[MaxLanes][LEN];
+    uint8_t out[MaxLanes][32];
+    Sha256MbJob jobs[MaxLanes];
+    for (size_t i = 0; i < MaxLanes; i++) {
+        memset(data[i], (int) i, LEN);
+        Sha256MbJob job = { data[i], LEN, 0, 0, out[i] };
+        jobs[i] = job;
+    }
+    double batch = fastestRun([&]() { hash(jobs, MaxLanes); }, 16);
+    double single = fastestRun([&]() {
+        for (size_t i = 0; i < MaxLanes; i++) {
+            SHA256 sha256;
+            sha256.add(data[i], LEN);
+            sha256.finalize(out[i]);
+        }
+    }, 16);
+
+    measuredBackend = backend;
+    measuredSha256 = SHA256::getBackend();
+    faster = batch < single;
+    return faster;
+#else
+    return false;
+#endif
+}
+
+void Sha256Mb::compress(uint32_t* const* states, const uint8_t* const* blocks, size_t count,
+                        size_t numBlocks) {
+    const Sha256MbBackend* backend = getBackend();
+    size_t lanes = backend->lanes;
+
+    for (size_t i = 0; i < count; i += lanes) {
+        if (count - i >= lanes) {
+            backend->compress(states + i, blocks + i, numBlocks, MaxLanes);
+            continue;
+        }
+
+        // fill the unused lanes of the last call with scratch work, their
+        // block pointers are set by the caller
+        uint32_t scratch[8];
+        uint32_t* s[MaxLanes];
+        for (size_t j = 0; j < lanes; j++) {
+            s[j] = i + j < count ? states[i + j] : scratch;
+        }
+        backend->compress(s, blocks + i, numBlocks, MaxLanes);
+    }
+}
+
+void Sha256Mb::hash(Sha256MbJob* jobs, size_t count) {
+    for (size_t i = 0; i < count; i += MaxLanes) {
+        hashGroup(jobs + i, count - i < MaxLanes ? count - i : MaxLanes);
+    }
+}
+
+void Sha256Mb::hashGroup(Sha256MbJob* jobs, size_t count) {
+    uint32_t states[MaxLanes][8];
+    // padded last one or two blocks of each message
+    uint8_t tails[MaxLanes][2 * 64];
+    size_t fullBlocks[MaxLanes];
+    size_t numBlocks[MaxLanes];
+    size_t maxBlocks = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const Sha256MbJob& job = jobs[i];
+        memcpy(states[i], job.midstate ? job.midstate : IV, sizeof(states[i]));
+
+        size_t rest = job.len % 64;
+        size_t tailLen = rest + 9 > 64 ? 128 : 64;
+        memcpy(tails[i], (const uint8_t*) job.data + job.len - rest, rest);
+        memset(tails[i] + rest, 0, tailLen - rest);
+        tails[i][rest] = 0x80;
+        uint64_t bits = (uint64_t) (job.prefixLen + job.len) * 8;
+        for (int j = 0; j < 8; j++) {
+            tails[i][tailLen - 1 - j] = (uint8_t) (bits >> (8 * j));
+        }
+
+        fullBlocks[i] = job.len / 64;
+        numBlocks[i] = fullBlocks[i] + tailLen / 64;
+        if (numBlocks[i] > maxBlocks) {
+            maxBlocks = numBlocks[i];
+        }
+    }
+
+    // Runs of blocks until the next lane is done, at most RUN_BLOCKS. Lanes
+    // that are done keep running on a scratch state. Unused lanes of the
+    // last backend call read the tail of the first message.
+    uint32_t scratch[MaxLanes][8];
+    const uint8_t* b[RUN_BLOCKS * MaxLanes];
+    for (size_t first = 0; first < maxBlocks;) {
+        size_t run = maxBlocks - first < RUN_BLOCKS ? maxBlocks - first : RUN_BLOCKS;
+        for (size_t i = 0; i < count; i++) {
+            if (numBlocks[i] > first && numBlocks[i] - first < run) {
+                run = numBlocks[i] - first;
+            }
+        }
+
+        uint32_t* s[MaxLanes];
+        for (size_t i = 0; i < MaxLanes; i++) {
+            s[i] = i < count && first < numBlocks[i] ? states[i] : scratch[i];
+            for (size_t k = 0; k < run; k++) {
+                size_t n = first + k;
+                const uint8_t*& block = b[k * MaxLanes + i];
+                if (i >= count || n >= numBlocks[i]) {
+                    block = tails[0];
+                } else if (n < fullBlocks[i]) {
+                    block = (const uint8_t*) jobs[i].data + 64 * n;
+                } else {
+                    block = tails[i] + 64 * (n - fullBlocks[i]);
+                }
+            }
+        }
+        compress(s, b, count, run);
+        first += run;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        for (int j = 0; j < 8; j++) {
+            jobs[i].out[4 * j] = (uint8_t) (states[i][j] >> 24);
+            jobs[i].out[4 * j + 1] = (uint8_t) (states[i][j] >> 16);
+            jobs[i].out[4 * j + 2] = (uint8_t) (states[i][j] >> 8);
+            jobs[i].out[4 * j + 3] = (uint8_t) states[i][j];
+        }
+    }
+}
+
+void Sha256Mb::hmac(HmacSha256MbJob* jobs, size_t count) {
+    for (size_t i = 0; i < count; i += MaxLanes) {
+        hmacGroup(jobs + i, count - i < MaxLanes ? count - i : MaxLanes);
+    }
+}
+
+void Sha256Mb::hmacGroup(HmacSha256MbJob* jobs, size_t count) {
+    uint32_t inner[MaxLanes][8];
+    uint32_t outer[MaxLanes][8];
+
+    // key midstates, for jobs without a keyed context
+    uint8_t ipad[MaxLanes][64];
+    uint8_t opad[MaxLanes][64];
+    uint32_t* s[2 * MaxLanes] = { 0 };
+    const uint8_t* b[2 * MaxLanes];
+    size_t numKeys = 0;
+    for (size_t i = 0; i < count; i++) {
+        const HmacSha256MbJob& job = jobs[i];
+        if (job.keyed) {
+            job.keyed->getMidstates(inner[i], outer[i]);
+            continue;
+        }
+
+        uint8_t correctedKey[64];
+        memset(correctedKey, 0, sizeof(correctedKey));
+        if (job.keyLen > 64) {
+            SHA256 sha256;
+            sha256.add(job.key, job.keyLen);
+            sha256.finalize(correctedKey);
+        } else {
+            memcpy(correctedKey, job.key, job.keyLen);
+        }
+        for (int j = 0; j < 64; j++) {
+            ipad[i][j] = correctedKey[j] ^ IPAD;
+            opad[i][j] = correctedKey[j] ^ OPAD;
+        }
+        memset(correctedKey, 0, sizeof(correctedKey));
+
+        memcpy(inner[i], IV, sizeof(IV));
+        memcpy(outer[i], IV, sizeof(IV));
+        s[numKeys] = inner[i];
+        b[numKeys++] = ipad[i];
+        s[numKeys] = outer[i];
+        b[numKeys++] = opad[i];
+    }
+    // one block each, unused lanes read the first pad
+    for (size_t i = numKeys; i < 2 * MaxLanes; i++) {
+        b[i] = ipad[0];
+    }
+    compress(s, b, numKeys, 1);
+    memset(ipad, 0, sizeof(ipad));
+    memset(opad, 0, sizeof(opad));
+
+    uint8_t innerHash[MaxLanes][HmacSha256::HashBytes];
+    Sha256MbJob hashJobs[MaxLanes];
+    for (size_t i = 0; i < count; i++) {
+        Sha256MbJob job = { jobs[i].message, jobs[i].messageLen, inner[i], 64, innerHash[i] };
+        hashJobs[i] = job;
+    }
+    hashGroup(hashJobs, count);
+
+    for (size_t i = 0; i < count; i++) {
+        Sha256MbJob job = { innerHash[i], HmacSha256::HashBytes, outer[i], 64, jobs[i].out };
+        hashJobs[i] = job;
+    }
+    hashGroup(hashJobs, count);
+}
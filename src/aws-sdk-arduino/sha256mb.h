@@ -0,0 +1,130 @@
+/*
+ * sha256mb.h
+ *
+ *  Multi-buffer SHA256 and HMAC-SHA256: independent messages are hashed in
+ *  parallel, one per SIMD lane.
+ */
+
+#ifndef SHA256MB_H_
+#define SHA256MB_H_
+
+#pragma once
+
+#include <stdint.h>
+#include "stddef.h"
+#include "sha256.h"
+#include "hmacsha256.h"
+
+/* Multi-buffer compression function backend, see Sha256Mb::setBackend(). */
+struct Sha256MbBackend
+{
+    /* Short name for reporting, e.g. "avx2" */
+    const char* name;
+    /* Number of messages processed by one call to compress */
+    size_t lanes;
+    /* Process numBlocks 64 byte blocks for each of the lanes, i.e. update
+     * states[i] with blocks[n * stride + i] for n = 0 .. numBlocks - 1. The
+     * states stay in the lanes from one block to the next. */
+    void (*compress)(uint32_t* const* states, const uint8_t* const* blocks, size_t numBlocks,
+                     size_t stride);
+    /* Return true if the backend can be used on this machine */
+    bool (*isAvailable)();
+};
+
+/* x86 SIMD backends (SSE2 and AVX2) are built with GCC or clang on x86,
+ * unless SHA256MB_NO_SIMD is defined. */
+#if !defined(SHA256MB_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) \
+        && (defined(__GNUC__) || defined(__clang__))
+#define SHA256MB_HAVE_SIMD 1
+#endif
+
+/* A message to hash. The hash may continue from a midstate, i.e. the SHA256
+ * state after prefixLen bytes (a multiple of 64) have been absorbed. */
+struct Sha256MbJob
+{
+    const void* data;
+    size_t len;
+    /* State to continue from, or 0 to start a new hash */
+    const uint32_t* midstate;
+    /* Number of bytes absorbed into midstate */
+    size_t prefixLen;
+    /* Receives the raw hash, 32 bytes */
+    uint8_t* out;
+};
+
+/* A message to authenticate, with either a raw key or a keyed HmacSha256
+ * context, which saves computing the key midstates. */
+struct HmacSha256MbJob
+{
+    /* Precomputed key, or 0 to use key and keyLen */
+    const HmacSha256* keyed;
+    const void* key;
+    size_t keyLen;
+    const void* message;
+    size_t messageLen;
+    /* Receives the raw MAC, HmacSha256::HashBytes bytes */
+    uint8_t* out;
+};
+
+/* Hash many short messages, e.g. one per signed URL.
+ *
+ * The messages of a group of MaxLanes jobs are processed block by block in
+ * lock step, so the work of a group is bound by its longest message. Works
+ * best for messages of similar length. Results are identical to SHA256 and
+ * HmacSha256 for any backend.
+ *
+ * Usage:
+ *  Sha256MbJob jobs[n];  // data, len, out (midstate 0)
+ *  Sha256Mb::hash(jobs, n);
+ */
+class Sha256Mb
+{
+public:
+    enum {
+        /* Most lanes of any backend, i.e. the group size. Without SIMD
+         * backends groups of one keep the stack use low, e.g. on the
+         * ESP8266. */
+#if defined(SHA256MB_HAVE_SIMD)
+        MaxLanes = 8
+#else
+        MaxLanes = 1
+#endif
+    };
+
+    /* Hash all jobs */
+    static void hash(Sha256MbJob* jobs, size_t count);
+
+    /* Compute the MAC of all jobs */
+    static void hmac(HmacSha256MbJob* jobs, size_t count);
+
+    /* Select the backend. 0 selects the best available one, which is also the
+     * default. That is the scalar backend if SHA256 uses the x86 SHA
+     * extensions, else the widest available SIMD backend. Returns false (and keeps the current backend) if the backend
+     * is not available. */
+    static bool setBackend(const Sha256MbBackend* backend);
+    /* Return the backend in use */
+    static const Sha256MbBackend* getBackend();
+    /* Return true if hashing MaxLanes signature sized messages with the
+     * backend in use is faster than hashing them one by one with the SHA256
+     * backend in use. Measured once for each pair of backends, false for a
+     * single lane. */
+    static bool batchIsFaster();
+    /* One lane at a time using the SHA256 backend, always available */
+    static const Sha256MbBackend* scalarBackend();
+    /* 4 lanes using SSE2, 0 if not built */
+    static const Sha256MbBackend* sse2Backend();
+    /* 8 lanes using AVX2, 0 if not built */
+    static const Sha256MbBackend* avx2Backend();
+
+private:
+    /* Hash up to MaxLanes jobs in lock step */
+    static void hashGroup(Sha256MbJob* jobs, size_t count);
+    /* Compute up to MaxLanes MACs */
+    static void hmacGroup(HmacSha256MbJob* jobs, size_t count);
+    /* Process numBlocks blocks for each of count states, backend->lanes at
+     * a time. Block n of state i is blocks[n * MaxLanes + i]. */
+    static void compress(uint32_t* const* states, const uint8_t* const* blocks, size_t count,
+                         size_t numBlocks);
+};
+
+#endif /* SHA256MB_H_ */
@@ -0,0 +1,241 @@
+/*
+ * sha256mb_x86.cpp
+ *
+ *  Multi-buffer SHA256 compression for x86, 4 lanes with SSE2 and 8 lanes
+ *  with AVX2. Lane i of every vector holds a word of message i, so each
+ *  instruction advances all messages by the same step.
+ *
+ *  Only built on x86 with GCC or clang, see SHA256MB_HAVE_SIMD in sha256mb.h.
+ *  The rounds use the compiler's generic vector extensions. Message words
+ *  and states are moved between messages and lanes with a register
+ *  transpose. The instruction set is selected per function so no special
+ *  compiler flags are needed.
+ */
+
+#include "sha256mb.h"
+
+#if defined(SHA256MB_HAVE_SIMD)
+
+#include <immintrin.h>
+
+namespace {
+
+typedef uint32_t Vec4 __attribute__((vector_size(16)));
+typedef uint32_t Vec8 __attribute__((vector_size(32)));
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/* 4x4 transpose of 32 bit words: row i becomes word i of every row */
+__attribute__((target("sse2"), always_inline))
+inline void transpose4(__m128i* r) {
+    __m128i t0 = _mm_unpacklo_epi32(r[0], r[1]);
+    __m128i t1 = _mm_unpackhi_epi32(r[0], r[1]);
+    __m128i t2 = _mm_unpacklo_epi32(r[2], r[3]);
+    __m128i t3 = _mm_unpackhi_epi32(r[2], r[3]);
+    r[0] = _mm_unpacklo_epi64(t0, t2);
+    r[1] = _mm_unpackhi_epi64(t0, t2);
+    r[2] = _mm_unpacklo_epi64(t1, t3);
+    r[3] = _mm_unpackhi_epi64(t1, t3);
+}
+
+/* 8x8 transpose of 32 bit words */
+__attribute__((target("avx2"), always_inline))
+inline void transpose8(__m256i* r) {
+    __m256i t[8], u[8];
+    for (int i = 0; i < 8; i += 2) {
+        t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 8; i += 4) {
+        u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (int i = 0; i < 4; i++) {
+        r[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+        r[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+    }
+}
+
+/* Message words of 4 blocks, big endian, word t of block l in w[t][l] */
+__attribute__((target("sse2"), always_inline))
+inline void loadWords(Vec4* w, const uint8_t* const* blocks) {
+    for (int t = 0; t < 16; t += 4) {
+        __m128i r[4];
+        for (int l = 0; l < 4; l++) {
+            r[l] = _mm_loadu_si128((const __m128i*) (blocks[l] + 4 * t));
+        }
+        transpose4(r);
+        for (int i = 0; i < 4; i++) {
+            // no byte shuffle in SSE2: swap bytes of each half, then halves
+            __m128i x = _mm_or_si128(_mm_slli_epi16(r[i], 8), _mm_srli_epi16(r[i], 8));
+            x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xb1), 0xb1);
+            w[t + i] = (Vec4) x;
+        }
+    }
+}
+
+__attribute__((target("avx2"), always_inline))
+inline void loadWords(Vec8* w, const uint8_t* const* blocks) {
+    const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    for (int t = 0; t < 16; t += 8) {
+        __m256i r[8];
+        for (int l = 0; l < 8; l++) {
+            r[l] = _mm256_loadu_si256((const __m256i*) (blocks[l] + 4 * t));
+        }
+        transpose8(r);
+        for (int i = 0; i < 8; i++) {
+            w[t + i] = (Vec8) _mm256_shuffle_epi8(r[i], bswap);
+        }
+    }
+}
+
+/* States of 4 or 8 messages to and from lanes, a transpose either way */
+__attribute__((target("sse2"), always_inline))
+inline void loadStates(Vec4* s, uint32_t* const* states) {
+    for (int j = 0; j < 8; j += 4) {
+        __m128i r[4];
+        for (int l = 0; l < 4; l++) {
+            r[l] = _mm_loadu_si128((const __m128i*) (states[l] + j));
+        }
+        transpose4(r);
+        for (int i = 0; i < 4; i++) {
+            s[j + i] = (Vec4) r[i];
+        }
+    }
+}
+
+__attribute__((target("sse2"), always_inline))
+inline void storeStates(uint32_t* const* states, const Vec4* s) {
+    for (int j = 0; j < 8; j += 4) {
+        __m128i r[4];
+        for (int i = 0; i < 4; i++) {
+            r[i] = (__m128i) s[j + i];
+        }
+        transpose4(r);
+        for (int l = 0; l < 4; l++) {
+            _mm_storeu_si128((__m128i*) (states[l] + j), r[l]);
+        }
+    }
+}
+
+__attribute__((target("avx2"), always_inline))
+inline void loadStates(Vec8* s, uint32_t* const* states) {
+    __m256i r[8];
+    for (int l = 0; l < 8; l++) {
+        r[l] = _mm256_loadu_si256((const __m256i*) states[l]);
+    }
+    transpose8(r);
+    for (int i = 0; i < 8; i++) {
+        s[i] = (Vec8) r[i];
+    }
+}
+
+__attribute__((target("avx2"), always_inline))
+inline void storeStates(uint32_t* const* states, const Vec8* s) {
+    __m256i r[8];
+    for (int i = 0; i < 8; i++) {
+        r[i] = (__m256i) s[i];
+    }
+    transpose8(r);
+    for (int l = 0; l < 8; l++) {
+        _mm256_storeu_si256((__m256i*) states[l], r[l]);
+    }
+}
+
+/* Compress one block per lane, w holds the message words and s the states.
+ * Always inlined into the wrappers below, so it is compiled for their
+ * instruction set. Vectors are never passed by value, which would depend on
+ * the ABI of the instruction set. */
+template <typename V>
+inline __attribute__((always_inline))
+void compressLanes(V* s, V* w) {
+    V a = s[0], b = s[1], c = s[2], d = s[3];
+    V e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int t = 0; t < 64; t++) {
+        V wt;
+        if (t < 16) {
+            wt = w[t];
+        } else {
+            V w15 = w[(t - 15) & 15];
+            V w2 = w[(t - 2) & 15];
+            wt = w[t & 15] + (ROTR(w15, 7) ^ ROTR(w15, 18) ^ (w15 >> 3)) + w[(t - 7) & 15]
+                    + (ROTR(w2, 17) ^ ROTR(w2, 19) ^ (w2 >> 10));
+            w[t & 15] = wt;
+        }
+
+        V t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + (g ^ (e & (f ^ g))) + K[t] + wt;
+        V t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) | (c & (a | b)));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    s[0] += a;
+    s[1] += b;
+    s[2] += c;
+    s[3] += d;
+    s[4] += e;
+    s[5] += f;
+    s[6] += g;
+    s[7] += h;
+}
+
+#undef ROTR
+
+/* The states are transposed into the lanes once for all blocks */
+__attribute__((target("sse2")))
+void compressSse2(uint32_t* const* states, const uint8_t* const* blocks, size_t numBlocks,
+                  size_t stride) {
+    Vec4 w[16], s[8];
+    loadStates(s, states);
+    for (size_t n = 0; n < numBlocks; n++, blocks += stride) {
+        loadWords(w, blocks);
+        compressLanes(s, w);
+    }
+    storeStates(states, s);
+}
+
+__attribute__((target("avx2")))
+void compressAvx2(uint32_t* const* states, const uint8_t* const* blocks, size_t numBlocks,
+                  size_t stride) {
+    Vec8 w[16], s[8];
+    loadStates(s, states);
+    for (size_t n = 0; n < numBlocks; n++, blocks += stride) {
+        loadWords(w, blocks);
+        compressLanes(s, w);
+    }
+    storeStates(states, s);
+}
+
+bool sse2Available() {
+    return __builtin_cpu_supports("sse2");
+}
+
+bool avx2Available() {
+    return __builtin_cpu_supports("avx2");
+}
+
+}
+
+extern const Sha256MbBackend SHA256MB_SSE2_BACKEND = { "sse2", 4, compressSse2, sse2Available };
+extern const Sha256MbBackend SHA256MB_AVX2_BACKEND = { "avx2", 8, compressAvx2, avx2Available };
+
+#endif
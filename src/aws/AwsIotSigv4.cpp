@@ -18,6 +18,7 @@
  * https://github.com/awslabs/aws-sdk-arduino/blob/master/src/common/AWSClient2.h
  */
 #include "aws-sdk-arduino/sha256.h"
+#include "aws-sdk-arduino/sha256mb.h"
 #include "aws-sdk-arduino/Utils.h"
 
 #include "AwsIotSigv4.h"
@@ -36,71 +37,159 @@ AwsIotSigv4::AwsIotSigv4(IDateTimeProvider *dtp,
         awsPort(mqttPort),
         awsKeyId(iamKeyId),
         awsSecretKey(iamSecretKey),
-        dateTimeProvider(dtp)
+        dateTimeProvider(dtp),
+        expires(0)
 {
+  invalidateSigningKey();
+  setExpires(AWS_IOT_PRESIGNED_URL_EXPIRES);
 }
 
 AwsIotSigv4::~AwsIotSigv4()
 {
 }
 
+void AwsIotSigv4::setCredentials(char *iamKeyId, char *iamSecretKey)
+{
+  awsKeyId = iamKeyId;
+  awsSecretKey = iamSecretKey;
+  invalidateSigningKey();
+}
+
+void AwsIotSigv4::invalidateSigningKey()
+{
+  signingHmac.setKey("", 0);
+  signingKeyDate[0] = '\0';
+  signingKeyRegion = 0;
+  signingKeySecret = 0;
+}
+
+void AwsIotSigv4::setExpires(unsigned long seconds)
+{
+  if (seconds < 1) {
+    seconds = 1;
+  } else if (seconds > SIGV4_MAX_EXPIRES) {
+    seconds = SIGV4_MAX_EXPIRES;
+  }
+  expires = seconds;
+}
+
+unsigned long AwsIotSigv4::getExpires()
+{
+  return expires;
+}
+
+void AwsIotSigv4::syncTime(const char* message)
+{
+  if (dateTimeProvider == 0) {
+    return;
+  }
+
+  if (!dateTimeProvider->syncTakesArg()) {
+    dateTimeProvider->sync(0);
+    return;
+  }
+
+  char* time = message != 0 ? getTimeFromInvalidSignatureMessage(message) : 0;
+  dateTimeProvider->sync(time);
+  delete[] time;
+}
+
 size_t AwsIotSigv4::createRequest(char** out)
 {
-  char* path;
-  size_t pathLen = createPath(&path);
-  size_t reqLen = strlen(awsHost) + pathLen + 7;
-  *out = new char[reqLen];
-  sprintf(*out, "wss://%s%s", awsHost, path);
-  delete[] path;
+  *out = 0;
+  if (dateTimeProvider == 0) {
+    return 0;
+  }
+
+  size_t reqLen = PROTOCOL_LEN + 3 + strlen(awsHost) + getPathLength() + 1;
+  char* req = new char[reqLen];
+  StringBuilder sb(req, reqLen);
+  sb.append(PROTOCOL, PROTOCOL_LEN).append("://", 3).append(awsHost);
+  if (!appendPath(sb)) {
+    delete[] req;
+    return 0;
+  }
+
+  *out = req;
   return reqLen;
 }
 
 size_t AwsIotSigv4::createPath(char** out)
 {
+  *out = 0;
   if (dateTimeProvider == 0) {
     return 0;
   }
 
-  // step 1
+  size_t pathLen = getPathLength() + 1;
+  char* path = new char[pathLen];
+  StringBuilder sb(path, pathLen);
+  if (!appendPath(sb)) {
+    delete[] path;
+    return 0;
+  }
+
+  *out = path;
+  return pathLen;
+}
+
+/* Path =
+ *   CanonicalURI + '?' +
+ *   CanonicalQueryString + '&X-Amz-Signature=' + Signature
+ */
+size_t AwsIotSigv4::getPathLength()
+{
+  return PATH_LEN + 1 +
+         QS_PREFIX_LEN + strlen(awsKeyId) + 3 + DATE_LEN + 3 + strlen(awsRegion) + CS_SUFFIX_ENCODED_LEN +
+         QS_DATE_LEN + DATE_LEN + 1 + TIME_LEN + 1 +
+         QS_EXPIRES_LEN + digitCount(expires) + QS_SUFFIX_LEN +
+         QS_SIGNATURE_LEN + HASH_HEX_LEN;
+}
+
+bool AwsIotSigv4::appendPath(StringBuilder& sb)
+{
   char date[DATE_LEN + 1];
   char time[TIME_LEN + 1];
   getDateTime(date, time);
 
-  int csLen = getCredentialStringLength();
-  char credentialString[csLen + 1];
-  getCredentialString(credentialString, date);
-
-  char queryString[QS_LEN + 1];
-  getQueryString(queryString, credentialString, date, time);
+  sb.append(PATH, PATH_LEN).append('?');
 
-  char payloadHash[HASH_HEX_LEN + 1];
-  getPayloadHash(payloadHash);
-
-  char canonicalRequest[CR_LEN];
-  createCanonicalRequest(canonicalRequest, queryString, payloadHash);
+  // The query string is kept in place and hashed as part of the canonical
+  // request, the signature is then appended to it.
+  size_t qsStart = sb.length();
+  appendQueryString(sb, date, time);
+  if (!sb.ok()) {
+    return false;
+  }
 
+  // step 1
   char canonicalRequestHash[HASH_HEX_LEN + 1];
-  getCanonicalRequestHash(canonicalRequestHash, canonicalRequest);
-
-  // step 2
-  csLen = getCredentialScopeLength();
-  char credentialScope[csLen + 1];
-  getCredentialScope(credentialScope, date);
-  char stringToSign[ALG_LEN + DATE_LEN + TIME_LEN + csLen + HASH_HEX_LEN + 6];
-  createStringToSign(stringToSign, date, time, credentialScope, canonicalRequestHash);
+  getCanonicalRequestHash(canonicalRequestHash, sb.c_str() + qsStart, sb.length() - qsStart);
 
-  // step 3
-  char signature[HASH_HEX_LEN];
-  createSignature(signature, stringToSign, date);
+  // step 2 and 3
+  uint8_t signature[SIGNING_KEY_LEN];
+  createSignature(signature, date, time, canonicalRequestHash);
 
   // step 4
-  addSignatureToQueryString(queryString, signature);
+  sb.append(QS_SIGNATURE, QS_SIGNATURE_LEN).appendHex(signature, SIGNING_KEY_LEN);
 
-  int requestLen = getRequestLength(queryString);
-  (*out) = new char[requestLen]();
-  addSignatureQSToRequest(*out, queryString);
+  return sb.ok();
+}
 
-  return requestLen;
+// Canonical query string, e.g.
+//   X-Amz-Algorithm=<algorithm>&X-Amz-Credential=<credential>&X-Amz-Date=<date>T<time>Z&...
+// where the credential is "<access key id>/<date>/<region>/<service>/aws4_request".
+// Must be URI encoded (i.e. '/' -> %2F and ' ' -> %20)
+void AwsIotSigv4::appendQueryString(StringBuilder& sb, char* date, char* time)
+{
+  sb.append(QS_PREFIX, QS_PREFIX_LEN)
+    .append(awsKeyId).append("%2F", 3)
+    .append(date, DATE_LEN).append("%2F", 3)
+    .append(awsRegion).append(CS_SUFFIX_ENCODED, CS_SUFFIX_ENCODED_LEN)
+    .append(QS_DATE, QS_DATE_LEN)
+    .append(date, DATE_LEN).append('T').append(time, TIME_LEN).append('Z')
+    .append(QS_EXPIRES, QS_EXPIRES_LEN).append((unsigned int) expires)
+    .append(QS_SUFFIX, QS_SUFFIX_LEN);
 }
 
 /* CanonicalRequest =
@@ -110,122 +199,299 @@ size_t AwsIotSigv4::createPath(char** out)
  *   CanonicalHeaders + '\n' +
  *   SignedHeaders + '\n' +
  *   HexEncode(Hash(RequestPayload))
+ *
+ * Only the query string and the host header (the only canonical header) vary.
+ * The payload is always empty, so its hash is a constant.
  */
-void AwsIotSigv4::createCanonicalRequest(char* out, char* qs, char* payloadHash)
+void AwsIotSigv4::getCanonicalRequestHash(char* out, const char* qs, size_t qsLen)
 {
-  // Method, URI
-  sprintf(out, "%s\n", METHOD);
-  sprintf(out, "%s%s\n", out, PATH);
-
-  // Query String
-  sprintf(out, "%s%s\n", out, qs);
+  char port[12];
+  StringBuilder portSb(port, sizeof(port));
+  portSb.append(':').append((unsigned int) awsPort);
+
+  SHA256 sha256;
+  sha256.add(CR_PREFIX, CR_PREFIX_LEN);
+  sha256.add(qs, qsLen);
+  sha256.add(CR_HOST, CR_HOST_LEN);
+  sha256.add(awsHost, strlen(awsHost));
+  sha256.add(portSb.c_str(), portSb.length());
+  sha256.add(CR_SUFFIX, CR_SUFFIX_LEN);
+  sha256.finalizeHex(out);
+}
 
-  // Canonical headers. Only host is used.
-  sprintf(out, "%shost:%s:%d\n\n", out, awsHost, awsPort);
+/* StringToSign =
+ *   Algorithm + '\n' +
+ *   RequestDateTime + '\n' +
+ *   CredentialScope + '\n' +
+ *   HexEncode(Hash(CanonicalRequest))
+ *
+ * signature = HMAC(kSigning, StringToSign)
+ */
+void AwsIotSigv4::createSignature(uint8_t* out, char* date, char* time, char* canonicalRequestHash)
+{
+  if (!hasSigningKey(date)) {
+    deriveSigningKey(date);
+  }
 
-  // Signed headers
-  sprintf(out, "%shost\n", out);
+  signingHmac.reset();
+  signingHmac.add(STS_PREFIX, STS_PREFIX_LEN);
+  signingHmac.add(date, DATE_LEN);
+  signingHmac.add("T", 1);
+  signingHmac.add(time, TIME_LEN);
+  signingHmac.add("Z\n", 2);
+  // Credential scope, e.g. "<date>/<region>/<service>/aws4_request"
+  signingHmac.add(date, DATE_LEN);
+  signingHmac.add("/", 1);
+  signingHmac.add(awsRegion, strlen(awsRegion));
+  signingHmac.add(CS_SUFFIX, CS_SUFFIX_LEN);
+  signingHmac.add("\n", 1);
+  signingHmac.add(canonicalRequestHash, HASH_HEX_LEN);
+  signingHmac.finalize(out);
+}
 
-  // Payload hash
-  sprintf(out, "%s%s", out, payloadHash);
+bool AwsIotSigv4::hasSigningKey(char* date)
+{
+  return signingKeyRegion == awsRegion &&
+         signingKeySecret == awsSecretKey &&
+         strncmp(signingKeyDate, date, DATE_LEN) == 0;
 }
 
-void AwsIotSigv4::createStringToSign(char *out, char* date, char* time, char* cs, char* canonicalRequestHash)
+size_t AwsIotSigv4::getSecretKey(const char* secret, uint8_t* key)
 {
-	sprintf(out, "%s\n%sT%sZ\n%s\n%s", ALGORITHM, date, time, cs, canonicalRequestHash);
+  static const size_t BLOCK_LEN = 64;
+  size_t len = strlen(secret);
+  if (4 + len <= BLOCK_LEN) {
+    memcpy(key, "AWS4", 4);
+    memcpy(key + 4, secret, len);
+    return 4 + len;
+  }
+
+  SHA256 sha256;
+  sha256.add("AWS4", 4);
+  sha256.add(secret, len);
+  sha256.finalize(key);
+  return SIGNING_KEY_LEN;
 }
 
-void AwsIotSigv4::createSignature(char* out, char* sts, char* date)
+void AwsIotSigv4::deriveSigningKey(char* date)
 {
-  int keyLen = SECRET_KEY_LEN + 4;
-  char* key = new char[keyLen + 1];
-  sprintf(key, "AWS4%s", awsSecretKey);
+  uint8_t key[64];
+  size_t keyLen = getSecretKey(awsSecretKey, key);
 
-  char* k1 = hmacSha256(key, keyLen, date, DATE_LEN);
-  delete[] key;
+  HmacSha256 hmac;
+  uint8_t k[SIGNING_KEY_LEN];
 
-  char* k2 = hmacSha256(k1, SHA256_DEC_HASH_LEN, awsRegion, strlen(awsRegion));
-  delete[] k1;
+  hmac.setKey(key, keyLen);
+  hmac.mac(date, DATE_LEN, k);
+  memset(key, 0, sizeof(key));
 
-  char* k3 = hmacSha256(k2, SHA256_DEC_HASH_LEN, SERVICE, strlen(SERVICE));
-  delete[] k2;
+  hmac.setKey(k, SIGNING_KEY_LEN);
+  hmac.mac(awsRegion, strlen(awsRegion), k);
 
-  char* k4 = hmacSha256(k3, SHA256_DEC_HASH_LEN, "aws4_request", 12);
-  delete[] k3;
+  hmac.setKey(k, SIGNING_KEY_LEN);
+  hmac.mac(SERVICE, SERVICE_LEN, k);
 
-  char* k5 = hmacSha256(k4, SHA256_DEC_HASH_LEN, sts, strlen(sts));
-  delete[] k4;
+  hmac.setKey(k, SIGNING_KEY_LEN);
+  hmac.mac(TERMINATOR, TERMINATOR_LEN, k);
 
-  /* Convert the chars in hash to hex for signature. */
-  for (int i = 0; i < SHA256_DEC_HASH_LEN; ++i) {
-      sprintf(out + 2 * i, "%02lx", 0xff & (unsigned long) k5[i]);
-  }
-  delete[] k5;
+  setSigningKey(date, k);
+  memset(k, 0, SIGNING_KEY_LEN);
 }
 
-void AwsIotSigv4::addSignatureToQueryString(char* out, char* signature)
+void AwsIotSigv4::setSigningKey(char* date, const uint8_t* k)
 {
-  sprintf(out, "%s&X-Amz-Signature=%s", out, signature);
+  signingHmac.setKey(k, SIGNING_KEY_LEN);
+  snprintf(signingKeyDate, DATE_LEN + 1, "%s", date);
+  signingKeyRegion = awsRegion;
+  signingKeySecret = awsSecretKey;
 }
 
-void AwsIotSigv4::addSignatureQSToRequest(char* out, char* qs)
+size_t AwsIotSigv4::createPaths(AwsIotSigv4* const* signers, size_t count, char** out)
 {
-  sprintf(out, "%s%s?%s", out, PATH, qs);
-}
-
-int AwsIotSigv4::getRequestLength(char* queryString) {
-  return strlen(PATH) + strlen(queryString)+2;
-}
-
-// Size of credential scope (not including terminating null char) */
-int AwsIotSigv4::getCredentialScopeLength() {
-  return DATE_LEN + strlen(awsRegion) + strlen(SERVICE) + 16;
+  size_t created = 0;
+  if (!Sha256Mb::batchIsFaster()) {
+    // e.g. a single lane, or SHA256 uses the SHA extensions
+    for (size_t i = 0; i < count; i++) {
+      created += signers[i]->createPath(out + i) ? 1 : 0;
+    }
+    return created;
+  }
+  for (size_t i = 0; i < count; i += Sha256Mb::MaxLanes) {
+    size_t n = count - i < Sha256Mb::MaxLanes ? count - i : Sha256Mb::MaxLanes;
+    created += createBatch(signers + i, n, out + i, false);
+  }
+  return created;
 }
 
-// Create credential scope, e.g. "/<date>/<region>/<service>/aws4_request"
-void AwsIotSigv4::getCredentialScope(char *out, char* date)
+size_t AwsIotSigv4::createRequests(AwsIotSigv4* const* signers, size_t count, char** out)
 {
-  sprintf(out, "%s/%s/%s/aws4_request", date, awsRegion, SERVICE);
-}
-
-// Size of credential scope (not including terminating null char) */
-int AwsIotSigv4::getCredentialStringLength() {
-  return ACCESS_KEY_ID_LEN + DATE_LEN + strlen(awsRegion) + strlen(SERVICE) + 24;
+  size_t created = 0;
+  if (!Sha256Mb::batchIsFaster()) {
+    // e.g. a single lane, or SHA256 uses the SHA extensions
+    for (size_t i = 0; i < count; i++) {
+      created += signers[i]->createRequest(out + i) ? 1 : 0;
+    }
+    return created;
+  }
+  for (size_t i = 0; i < count; i += Sha256Mb::MaxLanes) {
+    size_t n = count - i < Sha256Mb::MaxLanes ? count - i : Sha256Mb::MaxLanes;
+    created += createBatch(signers + i, n, out + i, true);
+  }
+  return created;
 }
 
-// Create credential string, e.g. "<access key id>/<date>/<region>/<service>/aws4_request"
-// Must be URI encoded (i.e. '/' -> %2F and ' ' -> %20)
-void AwsIotSigv4::getCredentialString(char *out, char* date)
+/* Same steps as appendPath(), but each step is done for the whole batch so
+ * that the hashing can be done in parallel. The canonical requests and
+ * strings to sign are built in a scratch buffer per signer, since the
+ * multi-buffer engine needs them in one piece. */
+size_t AwsIotSigv4::createBatch(AwsIotSigv4* const* signers, size_t count, char** out, bool withHost)
 {
-  sprintf(out, "%s%%2F%s%%2F%s%%2F%s%%2Faws4_request", awsKeyId, date, awsRegion, SERVICE);
-}
+  static const size_t MAX = Sha256Mb::MaxLanes;
+
+  // signers in this batch that could be started, with their state
+  size_t index[MAX];
+  size_t urlLen[MAX];
+  size_t urlUsed[MAX];
+  char* scratch[MAX];
+  size_t scratchSize[MAX];
+  char date[MAX][DATE_LEN + 1];
+  char time[MAX][TIME_LEN + 1];
+  size_t n = 0;
+
+  // unsigned URLs and canonical requests
+  Sha256MbJob hashJobs[MAX];
+  uint8_t hashes[MAX][SIGNING_KEY_LEN];
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = 0;
+    AwsIotSigv4* signer = signers[i];
+    if (signer == 0 || signer->dateTimeProvider == 0) {
+      continue;
+    }
+
+    size_t hostLen = strlen(signer->awsHost);
+    size_t len = signer->getPathLength() + 1;
+    if (withHost) {
+      len += PROTOCOL_LEN + 3 + hostLen;
+    }
+    char* url = new char[len];
+    StringBuilder sb(url, len);
+    if (withHost) {
+      sb.append(PROTOCOL, PROTOCOL_LEN).append("://", 3).append(signer->awsHost, hostLen);
+    }
+    signer->getDateTime(date[n], time[n]);
+    sb.append(PATH, PATH_LEN).append('?');
+    size_t qsStart = sb.length();
+    signer->appendQueryString(sb, date[n], time[n]);
+    size_t qsLen = sb.length() - qsStart;
+
+    size_t crLen = CR_PREFIX_LEN + qsLen + CR_HOST_LEN + hostLen + 11 + CR_SUFFIX_LEN;
+    size_t stsLen = STS_PREFIX_LEN + 2 * DATE_LEN + TIME_LEN + 5 + strlen(signer->awsRegion) +
+                    CS_SUFFIX_LEN + HASH_HEX_LEN;
+    size_t scratchLen = (crLen > stsLen ? crLen : stsLen) + 1;
+    char* buf = new char[scratchLen];
+    StringBuilder cr(buf, scratchLen);
+    cr.append(CR_PREFIX, CR_PREFIX_LEN)
+      .append(url + qsStart, qsLen)
+      .append(CR_HOST, CR_HOST_LEN)
+      .append(signer->awsHost, hostLen).append(':').append((unsigned int) signer->awsPort)
+      .append(CR_SUFFIX, CR_SUFFIX_LEN);
+    if (!sb.ok() || !cr.ok()) {
+      delete[] url;
+      delete[] buf;
+      continue;
+    }
+
+    out[i] = url;
+    index[n] = i;
+    urlLen[n] = len;
+    urlUsed[n] = sb.length();
+    scratch[n] = buf;
+    scratchSize[n] = scratchLen;
+    Sha256MbJob job = { buf, cr.length(), 0, 0, hashes[n] };
+    hashJobs[n] = job;
+    n++;
+  }
 
-void AwsIotSigv4::getQueryString(char* out, char* cs, char* date, char* time)
-{
-	sprintf(out, "X-Amz-Algorithm=%s", ALGORITHM);
-	sprintf(out, "%s&X-Amz-Credential=%s", out, cs);
-	sprintf(out, "%s&X-Amz-Date=%sT%sZ", out, date, time);
-  sprintf(out, "%s&X-Amz-Expires=86400", out);
-	sprintf(out, "%s&X-Amz-SignedHeaders=host", out);
-}
+  // step 1
+  Sha256Mb::hash(hashJobs, n);
+
+  // signing keys that are not cached yet, derived side by side
+  uint8_t secrets[MAX][64];
+  size_t secretLens[MAX];
+  uint8_t keys[MAX][SIGNING_KEY_LEN];
+  size_t derive[MAX];
+  size_t numDerive = 0;
+  for (size_t j = 0; j < n; ++j) {
+    AwsIotSigv4* signer = signers[index[j]];
+    if (!signer->hasSigningKey(date[j])) {
+      secretLens[numDerive] = getSecretKey(signer->awsSecretKey, secrets[numDerive]);
+      derive[numDerive++] = j;
+    }
+  }
+  if (numDerive > 0) {
+    HmacSha256MbJob keyJobs[MAX];
+    for (int step = 0; step < 4; ++step) {
+      for (size_t d = 0; d < numDerive; ++d) {
+        size_t j = derive[d];
+        AwsIotSigv4* signer = signers[index[j]];
+        HmacSha256MbJob job = { 0, keys[d], SIGNING_KEY_LEN, 0, 0, keys[d] };
+        if (step == 0) {
+          job.key = secrets[d];
+          job.keyLen = secretLens[d];
+          job.message = date[j];
+          job.messageLen = DATE_LEN;
+        } else if (step == 1) {
+          job.message = signer->awsRegion;
+          job.messageLen = strlen(signer->awsRegion);
+        } else if (step == 2) {
+          job.message = SERVICE;
+          job.messageLen = SERVICE_LEN;
+        } else {
+          job.message = TERMINATOR;
+          job.messageLen = TERMINATOR_LEN;
+        }
+        keyJobs[d] = job;
+      }
+      Sha256Mb::hmac(keyJobs, numDerive);
+    }
+    for (size_t d = 0; d < numDerive; ++d) {
+      size_t j = derive[d];
+      signers[index[j]]->setSigningKey(date[j], keys[d]);
+    }
+    memset(secrets, 0, sizeof(secrets));
+    memset(keys, 0, sizeof(keys));
+  }
 
-// Payload is always empty. Generate hash anyway.
-void AwsIotSigv4::getPayloadHash(char* out)
-{
-  SHA256* sha256 = new SHA256();
-  char* payloadHash = (*sha256)("", 0);
-  snprintf(out, HASH_HEX_LEN + 1, "%s", payloadHash);
-  delete[] payloadHash;
-  delete sha256;
-}
+  // step 2 and 3
+  HmacSha256MbJob signJobs[MAX];
+  for (size_t j = 0; j < n; ++j) {
+    AwsIotSigv4* signer = signers[index[j]];
+    StringBuilder sts(scratch[j], scratchSize[j]);
+    sts.append(STS_PREFIX, STS_PREFIX_LEN)
+       .append(date[j], DATE_LEN).append('T').append(time[j], TIME_LEN).append("Z\n", 2)
+       .append(date[j], DATE_LEN).append('/').append(signer->awsRegion)
+       .append(CS_SUFFIX, CS_SUFFIX_LEN).append('\n')
+       .appendHex(hashes[j], SIGNING_KEY_LEN);
+    HmacSha256MbJob job = { &signer->signingHmac, 0, 0, scratch[j], sts.length(), hashes[j] };
+    signJobs[j] = job;
+  }
+  Sha256Mb::hmac(signJobs, n);
 
-void AwsIotSigv4::getCanonicalRequestHash(char* out, char* canonicalRequest)
-{
-  SHA256* sha256 = new SHA256();
-  char* canonicalRequestHash = (*sha256)(canonicalRequest, strlen (canonicalRequest));
-  snprintf(out, HASH_HEX_LEN + 1, "%s", canonicalRequestHash);
-  delete[] canonicalRequestHash;
-	delete sha256;
+  // step 4
+  size_t created = 0;
+  for (size_t j = 0; j < n; ++j) {
+    char* url = out[index[j]];
+    StringBuilder sb(url + urlUsed[j], urlLen[j] - urlUsed[j]);
+    sb.append(QS_SIGNATURE, QS_SIGNATURE_LEN).appendHex(hashes[j], SIGNING_KEY_LEN);
+    delete[] scratch[j];
+    if (!sb.ok()) {
+      delete[] url;
+      out[index[j]] = 0;
+      continue;
+    }
+    created++;
+  }
+  return created;
 }
 
 void AwsIotSigv4::getDateTime(char* date, char* time)
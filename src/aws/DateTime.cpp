@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2017 Tomas Nilsson (joekickass)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *    http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <Arduino.h>
+
+#include "DateTime.h"
+
+static const uint32_t SECONDS_PER_DAY = 86400;
+
+// Days since 1970-01-01 of a date in the proleptic Gregorian calendar, for
+// years from 1970. See http://howardhinnant.github.io/date_algorithms.html
+static uint32_t daysFromCivil(uint32_t y, uint32_t m, uint32_t d)
+{
+  y -= m <= 2;
+  uint32_t era = y / 400;
+  uint32_t yoe = y - era * 400;
+  uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static void civilFromDays(uint32_t days, uint32_t* y, uint32_t* m, uint32_t* d)
+{
+  days += 719468;
+  uint32_t era = days / 146097;
+  uint32_t doe = days - era * 146097;
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+  *d = doy - (153 * mp + 2) / 5 + 1;
+  *m = mp < 10 ? mp + 3 : mp - 9;
+  *y = yoe + era * 400 + (*m <= 2);
+}
+
+static bool isLeapYear(uint32_t y)
+{
+  return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+// Parse n decimal digits, returns false on any other char
+static bool parseDigits(const char* s, int n, uint32_t* out)
+{
+  uint32_t value = 0;
+  for (int i = 0; i < n; ++i) {
+    if (s[i] < '0' || s[i] > '9') {
+      return false;
+    }
+    value = value * 10 + (s[i] - '0');
+  }
+  *out = value;
+  return true;
+}
+
+static void formatDigits(char* out, int n, uint32_t value)
+{
+  for (int i = n - 1; i >= 0; --i) {
+    out[i] = '0' + value % 10;
+    value /= 10;
+  }
+}
+
+bool dateTimeToEpoch(const char* dateTime, uint32_t* epoch)
+{
+  static const uint8_t DAYS_IN_MONTH[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+  uint32_t year, month, day, hour, minute, second;
+  if (dateTime == 0 ||
+      !parseDigits(dateTime, 4, &year) ||
+      !parseDigits(dateTime + 4, 2, &month) ||
+      !parseDigits(dateTime + 6, 2, &day) ||
+      !parseDigits(dateTime + 8, 2, &hour) ||
+      !parseDigits(dateTime + 10, 2, &minute) ||
+      !parseDigits(dateTime + 12, 2, &second)) {
+    return false;
+  }
+
+  if (year < 1970 || year > 2105 || month < 1 || month > 12 || day < 1 ||
+      day > DAYS_IN_MONTH[month - 1] + (uint32_t) (month == 2 && isLeapYear(year)) ||
+      hour > 23 || minute > 59 || second > 60) {
+    return false;
+  }
+
+  *epoch = daysFromCivil(year, month, day) * SECONDS_PER_DAY + hour * 3600 + minute * 60 + second;
+  return true;
+}
+
+void epochToDateTime(uint32_t epoch, char* out)
+{
+  uint32_t year, month, day;
+  civilFromDays(epoch / SECONDS_PER_DAY, &year, &month, &day);
+  uint32_t secondOfDay = epoch % SECONDS_PER_DAY;
+
+  formatDigits(out, 4, year);
+  formatDigits(out + 4, 2, month);
+  formatDigits(out + 6, 2, day);
+  formatDigits(out + 8, 2, secondOfDay / 3600);
+  formatDigits(out + 10, 2, secondOfDay / 60 % 60);
+  formatDigits(out + 12, 2, secondOfDay % 60);
+  out[DATE_TIME_LEN] = '\0';
+}
+
+UtcClock::UtcClock() : epoch(0), anchor(0), setAt(0), valid(false)
+{
+}
+
+void UtcClock::set(uint32_t seconds, uint16_t millisecond)
+{
+  setAt = millis();
+  anchor = setAt - millisecond;
+  epoch = seconds;
+  valid = true;
+}
+
+void UtcClock::clear()
+{
+  valid = false;
+}
+
+bool UtcClock::isSet()
+{
+  return valid;
+}
+
+uint32_t UtcClock::now()
+{
+  if (!valid) {
+    return 0;
+  }
+
+  // Move the anchor forward in whole seconds, so that the elapsed time never
+  // gets close to wrapping around.
+  uint32_t elapsed = (uint32_t) millis() - anchor;
+  epoch += elapsed / 1000;
+  anchor += elapsed / 1000 * 1000;
+  return epoch;
+}
+
+uint32_t UtcClock::sinceSet()
+{
+  return (uint32_t) millis() - setAt;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2017 Tomas Nilsson (joekickass)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *    http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DATETIME_H_
+#define DATETIME_H_
+
+#include <stdint.h>
+
+/* Length of a date and time in yyyyMMddHHmmss format (not including
+ * terminating null char) */
+static constexpr int DATE_TIME_LEN = 14;
+
+/*
+ * Convert a UTC date and time in yyyyMMddHHmmss format to seconds since
+ * 1970-01-01 00:00:00. Returns false if dateTime is not a valid date and time
+ * between 1970 and 2105.
+ */
+bool dateTimeToEpoch(const char* dateTime, uint32_t* epoch);
+
+/*
+ * Format seconds since 1970-01-01 00:00:00 as UTC date and time in
+ * yyyyMMddHHmmss format. out must hold DATE_TIME_LEN + 1 chars.
+ */
+void epochToDateTime(uint32_t epoch, char* out);
+
+/*
+ * UtcClock
+ *
+ * Keeps UTC time without a real time clock. It is set once from a time
+ * source, after which the time is derived from millis(). Handles millis()
+ * wrapping around after 49.7 days, as long as now() is called at least once
+ * in that period.
+ */
+class UtcClock
+{
+  public:
+    UtcClock();
+
+    /* Set the current time, in seconds and milliseconds since epoch */
+    void set(uint32_t epoch, uint16_t millisecond = 0);
+
+    /* Forget the time, isSet() returns false until the next set() */
+    void clear();
+
+    /* Return true if the clock has been set */
+    bool isSet();
+
+    /* Current time in seconds since epoch. 0 if the clock is not set. */
+    uint32_t now();
+
+    /* Milliseconds since the clock was last set */
+    uint32_t sinceSet();
+
+  private:
+
+    /* Time in seconds since epoch at millis() == anchor */
+    uint32_t epoch;
+    uint32_t anchor;
+
+    /* millis() at last set() */
+    uint32_t setAt;
+
+    bool valid;
+};
+
+#endif
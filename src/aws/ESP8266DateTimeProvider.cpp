@@ -16,24 +16,94 @@
 
 #include <aws/ESP8266DateTimeProvider.h>
 
-ESP8266DateTimeProvider::ESP8266DateTimeProvider() : timeClient()
+#include "aws_iot_config.h"
+
+ESP8266DateTimeProvider::ESP8266DateTimeProvider() :
+  clock(),
+  formatted(0),
+  resyncInterval(AWS_IOT_TIME_RESYNC_INTERVAL),
+  lastSyncAttempt(0),
+  syncAttempted(false),
+  timeClient()
 {
   strcpy(dateTime,"20120101000000");
 }
 
 const char* ESP8266DateTimeProvider::getDateTime()
 {
-  sync(0);
+  if (needsSync()) {
+    query();
+  }
+
+  if (clock.isSet()) {
+    uint32_t now = clock.now();
+    if (now != formatted) {
+      epochToDateTime(now, dateTime);
+      formatted = now;
+    }
+  }
   return dateTime;
 }
 
-bool ESP8266DateTimeProvider::syncTakesArg(void)
+void ESP8266DateTimeProvider::setResyncInterval(unsigned long ms)
+{
+  resyncInterval = ms;
+}
+
+bool ESP8266DateTimeProvider::isSynced()
+{
+  return clock.isSet();
+}
+
+bool ESP8266DateTimeProvider::needsSync()
 {
+  if (!syncAttempted) {
+    return true;
+  }
+
+  // Don't hammer the time server if it is unreachable
+  if ((uint32_t) (millis() - lastSyncAttempt) < AWS_IOT_TIME_SYNC_RETRY_INTERVAL) {
     return false;
+  }
+
+  if (!clock.isSet()) {
+    return true;
+  }
+  return resyncInterval > 0 && clock.sinceSet() >= resyncInterval;
+}
+
+bool ESP8266DateTimeProvider::syncTakesArg(void)
+{
+    return true;
 }
 
 void ESP8266DateTimeProvider::sync(const char* dt)
 {
+  // Time reported by AWS, no need to ask the time server
+  uint32_t epoch;
+  if (dt != 0 && dateTimeToEpoch(dt, &epoch)) {
+    syncAttempted = true;
+    lastSyncAttempt = millis();
+    clock.set(epoch);
+    epochToDateTime(epoch, dateTime);
+    formatted = epoch;
+    return;
+  }
+
+  // Every rejected handshake ends up here, usually without a time. The
+  // clock is likely off, so don't wait for the re-sync interval, but the
+  // request blocks, so only make one for a burst of rejections.
+  if (syncAttempted && (uint32_t) (millis() - lastSyncAttempt) < AWS_IOT_TIME_SYNC_RETRY_INTERVAL) {
+    return;
+  }
+  query();
+}
+
+void ESP8266DateTimeProvider::query()
+{
+  syncAttempted = true;
+  lastSyncAttempt = millis();
+
   if (!timeClient.connect("aws.amazon.com", 80)) {
     Serial.println("Could not connect to timeserver. Using old timestamp");
     return;
@@ -44,48 +114,31 @@ void ESP8266DateTimeProvider::sync(const char* dt)
   timeClient.println("Connection: close");
   timeClient.println();
 
-  int timeout_busy = 0;
-  while( ( !timeClient.available() ) && ( timeout_busy++ < 5000 ) ) {
-    // Wait until the client sends some data
-    delay(1);
-  }
-
-  // kill client if timeout
-  if(timeout_busy >= 5000) {
-    timeClient.flush();
-    timeClient.stop();
-    Serial.println("Timeout receiving timeserver data. Using old timestamp");
-    return;
+  // Read until the Date header is parsed, then drop the connection. The
+  // rest of the response is not needed.
+  HttpDateParser parser;
+  char buf[64];
+  unsigned long start = millis();
+  while (parser.getState() == HttpDateParser::PARSING &&
+         (uint32_t) (millis() - start) < 5000) {
+    int n = timeClient.read((uint8_t*) buf, sizeof(buf));
+    if (n > 0) {
+      parser.feed(buf, n);
+    } else if (!timeClient.connected()) {
+      break;
+    } else {
+      delay(1);
+    }
   }
-
-  // read the http GET Response
-  String req2 = timeClient.readString();
-
-  // close connection
-  delay(1);
-  timeClient.flush();
   timeClient.stop();
 
-  int ipos = req2.indexOf("Date:");
-  if(ipos > 0) {
-    String gmtDate = req2.substring(ipos, ipos + 35);
-    String utctime = gmtDate.substring(18,22) + getMonth(gmtDate.substring(14,17)) + gmtDate.substring(11,13) + gmtDate.substring(23,25) + gmtDate.substring(26,28) + gmtDate.substring(29,31);
-    utctime.substring(0, 14).toCharArray(dateTime, 15);
+  if (parser.getState() != HttpDateParser::DONE) {
+    Serial.println("No time in timeserver response. Using old timestamp");
+    return;
   }
-}
 
-String ESP8266DateTimeProvider::getMonth(String sM) {
-  if(sM=="Jan") return "01";
-  if(sM=="Feb") return "02";
-  if(sM=="Mar") return "03";
-  if(sM=="Apr") return "04";
-  if(sM=="May") return "05";
-  if(sM=="Jun") return "06";
-  if(sM=="Jul") return "07";
-  if(sM=="Aug") return "08";
-  if(sM=="Sep") return "09";
-  if(sM=="Oct") return "10";
-  if(sM=="Nov") return "11";
-  if(sM=="Dec") return "12";
-  return "01";
+  uint32_t epoch = parser.getEpoch();
+  clock.set(epoch);
+  epochToDateTime(epoch, dateTime);
+  formatted = epoch;
 }
@@ -24,13 +24,24 @@
 #include <ESP8266WiFi.h>
 
 #include "aws-sdk-arduino/DeviceIndependentInterfaces.h"
+#include "aws/DateTime.h"
+#include "aws/HttpDateParser.h"
 
+/*
+ * ESP8266DateTimeProvider
+ *
+ * Gets the time from the Date header of a HTTP response from aws.amazon.com.
+ * The time server is only contacted on the first call to getDateTime() and
+ * then every re-sync interval. In between, the time is derived from millis().
+ */
 class ESP8266DateTimeProvider : public IDateTimeProvider
 {
   public:
     ESP8266DateTimeProvider();
 
-    /* Retrieve the current GMT date and time in yyyyMMddHHmmss format. */
+    /* Retrieve the current GMT date and time in yyyyMMddHHmmss format. Syncs
+     * with the time server if the time is not known yet or the re-sync
+     * interval has passed, else no network I/O is done. */
     virtual const char* getDateTime(void);
 
     /* Return true if the sync function requires the current time as in
@@ -38,19 +49,45 @@ class ESP8266DateTimeProvider : public IDateTimeProvider
     virtual bool syncTakesArg(void);
 
     /* Called if AWS Service reports in accurate time. Sets the provider to
-     * current time. If syncTakesArg() returns true, this argument takes the
-     * current GMT date and time in yyyyMMddHHmmss format. Else, the nput value
-     * is ignored and may be null. */
+     * dt, the current GMT date and time in yyyyMMddHHmmss format. If dt is
+     * null or not valid, the time server is contacted instead, even within
+     * the re-sync interval. A burst of rejections only causes one request:
+     * none is made within AWS_IOT_TIME_SYNC_RETRY_INTERVAL of the last
+     * attempt. */
     virtual void sync(const char* dt);
 
+    /* Set how often (ms) the time is synced with the time server. 0 means
+     * never after the first successful sync. Defaults to
+     * AWS_IOT_TIME_RESYNC_INTERVAL. */
+    void setResyncInterval(unsigned long ms);
+
+    /* Return true once the time has been synced with the time server */
+    bool isSynced();
+
   private:
 
     /* DateTime in yyyyMMddHHmmss format */
     char dateTime[15];
 
-    WiFiClient timeClient;
+    /* Time since the last successful sync */
+    UtcClock clock;
 
-    String getMonth(String sM);
+    /* Epoch of the time in dateTime, to only format it once per second */
+    uint32_t formatted;
+
+    unsigned long resyncInterval;
+
+    /* millis() at the last sync attempt, successful or not */
+    unsigned long lastSyncAttempt;
+    bool syncAttempted;
+
+    /* Return true if it is time to contact the time server */
+    bool needsSync();
+
+    /* Get the time from the time server. Blocks for up to several seconds. */
+    void query();
+
+    WiFiClient timeClient;
 };
 
 #endif
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2017 Tomas Nilsson (joekickass)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *    http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ESP8266UdpTransport.h"
+
+ESP8266UdpTransport::ESP8266UdpTransport(uint16_t localPort) :
+  udp(),
+  localPort(localPort),
+  started(false)
+{
+}
+
+ESP8266UdpTransport::~ESP8266UdpTransport()
+{
+  if (started) {
+    udp.stop();
+  }
+}
+
+bool ESP8266UdpTransport::send(const char* host, uint16_t port, const uint8_t* data, size_t len)
+{
+  // WiFi may not be up when the transport is created, so bind on first use
+  if (!started) {
+    if (!udp.begin(localPort)) {
+      return false;
+    }
+    started = true;
+  }
+
+  if (!udp.beginPacket(host, port)) {
+    return false;
+  }
+  udp.write(data, len);
+  return udp.endPacket() == 1;
+}
+
+size_t ESP8266UdpTransport::receive(uint8_t* buf, size_t len)
+{
+  if (!started || udp.parsePacket() <= 0) {
+    return 0;
+  }
+
+  // The rest of a datagram longer than len is dropped by the next
+  // parsePacket()
+  int read = udp.read(buf, len);
+  return read > 0 ? read : 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2017 Tomas Nilsson (joekickass)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *    http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ESP8266UDPTRANSPORT_H_
+#define ESP8266UDPTRANSPORT_H_
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#include "aws/SntpDateTimeProvider.h"
+
+/*
+ * SntpTransport over WiFiUDP.
+ *
+ * Host names are resolved by WiFiUDP on every send, which blocks until the
+ * DNS reply arrives. Use IP addresses to avoid that.
+ */
+class ESP8266UdpTransport : public SntpTransport
+{
+  public:
+    ESP8266UdpTransport(uint16_t localPort = AWS_IOT_SNTP_LOCAL_PORT);
+    ~ESP8266UdpTransport();
+
+    bool send(const char* host, uint16_t port, const uint8_t* data, size_t len);
+    size_t receive(uint8_t* buf, size_t len);
+
+  private:
+
+    WiFiUDP udp;
+    uint16_t localPort;
+    bool started;
+};
+
+#endif
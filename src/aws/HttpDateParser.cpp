@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2017 Tomas Nilsson (joekickass)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *    http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "HttpDateParser.h"
+
+#include "DateTime.h"
+
+// Month number by ((2nd letter & 0x1f) + (3rd letter & 0x1f)) & 0x1f, which
+// is unique for the twelve month names and ignores case. 0 if no month.
+static const uint8_t MONTH_BY_HASH[32] = {
+  0,  7,  4,  6,  0, 11,  0,  2, 12,  0,  0,  0,  0,  0,  0,  1,
+  0,  0,  0,  3,  0,  9,  0, 10,  0,  0,  5,  0,  8,  0,  0,  0
+};
+
+static const char MONTH_NAMES[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+
+static char toLower(char c)
+{
+  return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// Month (1-12) of a three letter English month name, 0 if not a month
+static int parseMonth(const char* s)
+{
+  int month = MONTH_BY_HASH[((s[1] & 0x1f) + (s[2] & 0x1f)) & 0x1f];
+  if (month == 0) {
+    return 0;
+  }
+  const char* name = MONTH_NAMES + (month - 1) * 3;
+  if (toLower(s[0]) != name[0] || toLower(s[1]) != name[1] || toLower(s[2]) != name[2]) {
+    return 0;
+  }
+  return month;
+}
+
+static bool isDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+HttpDateParser::HttpDateParser()
+{
+  reset();
+}
+
+void HttpDateParser::reset()
+{
+  lineLen = 0;
+  firstLine = true;
+  state = PARSING;
+  epoch = 0;
+}
+
+HttpDateParser::State HttpDateParser::getState()
+{
+  return state;
+}
+
+uint32_t HttpDateParser::getEpoch()
+{
+  return epoch;
+}
+
+size_t HttpDateParser::feed(const char* data, size_t len)
+{
+  size_t i = 0;
+  while (state == PARSING && i < len) {
+    char c = data[i++];
+    if (c == '\n') {
+      endLine();
+    } else if (c != '\r' && lineLen < LINE_LEN) {
+      line[lineLen++] = c;
+    }
+  }
+  return i;
+}
+
+void HttpDateParser::endLine()
+{
+  size_t len = lineLen;
+  lineLen = 0;
+
+  if (firstLine) {
+    firstLine = false;
+    return;
+  }
+
+  // Empty line ends the headers
+  if (len == 0) {
+    state = FAILED;
+    return;
+  }
+
+  // Header names are case insensitive
+  if (len < 5 || toLower(line[0]) != 'd' || toLower(line[1]) != 'a' ||
+      toLower(line[2]) != 't' || toLower(line[3]) != 'e' || line[4] != ':') {
+    return;
+  }
+
+  size_t start = 5;
+  while (start < len && (line[start] == ' ' || line[start] == '\t')) {
+    ++start;
+  }
+  state = parseDate(line + start, len - start) ? DONE : FAILED;
+}
+
+/*
+ * Only the preferred format of RFC 7231 (IMF-fixdate) is accepted:
+ *
+ *   Mon, 08 May 2017 12:30:58 GMT
+ *   0123456789012345678901234567
+ */
+bool HttpDateParser::parseDate(const char* value, size_t len)
+{
+  static const char PATTERN[] = "aaa, dd aaa dddd dd:dd:dd GMT";
+  static const size_t PATTERN_LEN = sizeof(PATTERN) - 1;
+
+  if (len < PATTERN_LEN) {
+    return false;
+  }
+  for (size_t i = 0; i < PATTERN_LEN; ++i) {
+    char p = PATTERN[i];
+    if (p == 'd' ? !isDigit(value[i]) : p != 'a' && p != value[i]) {
+      return false;
+    }
+  }
+
+  int month = parseMonth(value + 8);
+  if (month == 0) {
+    return false;
+  }
+
+  // yyyyMMddHHmmss
+  char dateTime[DATE_TIME_LEN + 1];
+  dateTime[0] = value[12];
+  dateTime[1] = value[13];
+  dateTime[2] = value[14];
+  dateTime[3] = value[15];
+  dateTime[4] = '0' + month / 10;
+  dateTime[5] = '0' + month % 10;
+  dateTime[6] = value[5];
+  dateTime[7] = value[6];
+  dateTime[8] = value[17];
+  dateTime[9] = value[18];
+  dateTime[10] = value[20];
+  dateTime[11] = value[21];
+  dateTime[12] = value[23];
+  dateTime[13] = value[24];
+  dateTime[14] = '\0';
+
+  return dateTimeToEpoch(dateTime, &epoch);
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 Tomas Nilsson (joekickass)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *    http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HTTPDATEPARSER_H_
+#define HTTPDATEPARSER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * HttpDateParser
+ *
+ * Finds the Date header in a HTTP response, e.g.
+ *
+ *   Date: Mon, 08 May 2017 12:30:58 GMT
+ *
+ * The response is fed in chunks as it is received. Only the start of the
+ * current line is buffered, so no memory is allocated no matter how long
+ * the response is. Parsing stops at the Date header, or at the end of the
+ * headers if there is none.
+ */
+class HttpDateParser
+{
+  public:
+    enum State {
+      PARSING,  // Needs more data
+      DONE,     // Date header found, see getEpoch()
+      FAILED    // No valid Date header
+    };
+
+    HttpDateParser();
+
+    /* Start over with a new response */
+    void reset();
+
+    /* Feed the next len bytes of the response. Returns the number of bytes
+     * consumed, which is less than len if parsing stopped within data. */
+    size_t feed(const char* data, size_t len);
+
+    State getState();
+
+    /* Seconds since epoch of the Date header, if getState() == DONE */
+    uint32_t getEpoch();
+
+  private:
+
+    /* "Date: Mon, 08 May 2017 12:30:58 GMT" plus a few spare spaces. Longer
+     * lines are truncated, the rest is not needed. */
+    static const size_t LINE_LEN = 40;
+
+    char line[LINE_LEN];
+    size_t lineLen;
+
+    /* Status line is not a header */
+    bool firstLine;
+
+    State state;
+    uint32_t epoch;
+
+    /* Handle a complete line, without line ending */
+    void endLine();
+
+    /* Parse the value of a Date header */
+    bool parseDate(const char* value, size_t len);
+};
+
+#endif
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2017 Tomas Nilsson (joekickass)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *    http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <Arduino.h>
+
+#include "SntpDateTimeProvider.h"
+
+// Seconds from 1900-01-01 (start of NTP era 0) to 1970-01-01
+static const uint32_t NTP_UNIX_OFFSET = 2208988800UL;
+
+// Header fields
+static const uint8_t NTP_VERSION = 4;
+static const uint8_t NTP_MODE_CLIENT = 3;
+static const uint8_t NTP_MODE_SERVER = 4;
+static const uint8_t NTP_LEAP_UNSYNCHRONIZED = 3;
+
+// Timestamp offsets in a packet
+static const int NTP_ORIGINATE = 24;
+static const int NTP_RECEIVE = 32;
+static const int NTP_TRANSMIT = 40;
+
+static uint32_t readBigEndian(const uint8_t* p)
+{
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static void writeBigEndian(uint8_t* p, uint32_t value)
+{
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+}
+
+// Milliseconds since the start of the NTP era of a timestamp
+static uint64_t timestampToMillis(const uint8_t* p)
+{
+  uint64_t fraction = readBigEndian(p + 4);
+  return (uint64_t) readBigEndian(p) * 1000 + ((fraction * 1000) >> 32);
+}
+
+SntpDateTimeProvider::SntpDateTimeProvider(SntpTransport& transport) :
+  transport(transport),
+  numServers(0),
+  current(-1),
+  sentAt(0),
+  lastAttempt(0),
+  attempted(false),
+  syncRequested(false),
+  resyncInterval(AWS_IOT_TIME_RESYNC_INTERVAL),
+  timeout(AWS_IOT_SNTP_TIMEOUT),
+  lastDelay(0),
+  clock(),
+  formatted(0)
+{
+  cookie[0] = 0;
+  cookie[1] = 0;
+  strcpy(dateTime, "20120101000000");
+}
+
+bool SntpDateTimeProvider::addServer(const char* host, uint16_t port)
+{
+  if (numServers >= AWS_IOT_SNTP_MAX_SERVERS) {
+    return false;
+  }
+  servers[numServers].host = host;
+  servers[numServers].port = port;
+  numServers++;
+  return true;
+}
+
+void SntpDateTimeProvider::poll()
+{
+  uint8_t packet[SNTP_PACKET_LEN];
+  size_t len;
+  while ((len = transport.receive(packet, sizeof(packet))) > 0) {
+    if (current >= 0) {
+      handleReply(packet, len);
+    }
+  }
+
+  if (current >= 0 && (uint32_t) (millis() - sentAt) >= timeout) {
+    nextServer();
+  }
+
+  if (current < 0 && needsSync()) {
+    attempted = true;
+    syncRequested = false;
+    lastAttempt = millis();
+    nextServer();
+  }
+}
+
+void SntpDateTimeProvider::requestSync()
+{
+  syncRequested = true;
+}
+
+bool SntpDateTimeProvider::isSynced()
+{
+  return clock.isSet();
+}
+
+bool SntpDateTimeProvider::isQuerying()
+{
+  return current >= 0;
+}
+
+void SntpDateTimeProvider::setResyncInterval(unsigned long ms)
+{
+  resyncInterval = ms;
+}
+
+void SntpDateTimeProvider::setTimeout(unsigned long ms)
+{
+  timeout = ms;
+}
+
+unsigned long SntpDateTimeProvider::getLastDelay()
+{
+  return lastDelay;
+}
+
+const char* SntpDateTimeProvider::getDateTime()
+{
+  poll();
+
+  if (clock.isSet()) {
+    uint32_t now = clock.now();
+    if (now != formatted) {
+      epochToDateTime(now, dateTime);
+      formatted = now;
+    }
+  }
+  return dateTime;
+}
+
+bool SntpDateTimeProvider::syncTakesArg(void)
+{
+  return true;
+}
+
+void SntpDateTimeProvider::sync(const char* dt)
+{
+  // Time reported by AWS. Only accurate to the second, the next reply from a
+  // server replaces it.
+  uint32_t epoch;
+  if (dt != 0 && dateTimeToEpoch(dt, &epoch)) {
+    clock.set(epoch);
+    return;
+  }
+
+  // Every rejected handshake ends up here, usually without a time. The
+  // clock is likely off, so don't wait for the re-sync interval, but only
+  // query once for a burst of rejections.
+  if (numServers > 0 && current < 0 &&
+      (!attempted || (uint32_t) (millis() - lastAttempt) >= AWS_IOT_TIME_SYNC_RETRY_INTERVAL)) {
+    requestSync();
+  }
+}
+
+bool SntpDateTimeProvider::needsSync()
+{
+  if (numServers == 0) {
+    return false;
+  }
+  if (!attempted || syncRequested) {
+    return true;
+  }
+
+  // Don't hammer the servers if they are unreachable
+  if ((uint32_t) (millis() - lastAttempt) < AWS_IOT_TIME_SYNC_RETRY_INTERVAL) {
+    return false;
+  }
+
+  if (!clock.isSet()) {
+    return true;
+  }
+  return resyncInterval > 0 && clock.sinceSet() >= resyncInterval;
+}
+
+void SntpDateTimeProvider::nextServer()
+{
+  for (int i = current + 1; i < numServers; ++i) {
+    if (sendQuery(i)) {
+      current = i;
+      return;
+    }
+  }
+
+  // All servers failed, try again after AWS_IOT_TIME_SYNC_RETRY_INTERVAL
+  current = -1;
+}
+
+bool SntpDateTimeProvider::sendQuery(int index)
+{
+  uint8_t packet[SNTP_PACKET_LEN];
+  memset(packet, 0, sizeof(packet));
+  packet[0] = (NTP_VERSION << 3) | NTP_MODE_CLIENT;
+
+  // The transmit timestamp is only used to match the reply, so any value
+  // that changes between queries will do.
+  cookie[0] = micros();
+  cookie[1] = cookie[1] * 2654435761UL + millis() + 1;
+  writeBigEndian(packet + NTP_TRANSMIT, cookie[0]);
+  writeBigEndian(packet + NTP_TRANSMIT + 4, cookie[1]);
+
+  sentAt = millis();
+  return transport.send(servers[index].host, servers[index].port, packet, sizeof(packet));
+}
+
+bool SntpDateTimeProvider::handleReply(const uint8_t* packet, size_t len)
+{
+  if (len < (size_t) SNTP_PACKET_LEN ||
+      (packet[0] & 7) != NTP_MODE_SERVER ||
+      readBigEndian(packet + NTP_ORIGINATE) != cookie[0] ||
+      readBigEndian(packet + NTP_ORIGINATE + 4) != cookie[1]) {
+    // Not a reply to the current query
+    return false;
+  }
+
+  // Kiss-o'-death (stratum 0) or a server that is not synchronized
+  uint8_t stratum = packet[1];
+  if ((packet[0] >> 6) == NTP_LEAP_UNSYNCHRONIZED || stratum == 0 || stratum > 15 ||
+      readBigEndian(packet + NTP_TRANSMIT) == 0) {
+    nextServer();
+    return false;
+  }
+
+  // Round trip delay, not counting the time the server held the query
+  uint32_t roundTrip = millis() - sentAt;
+  uint64_t received = timestampToMillis(packet + NTP_RECEIVE);
+  uint64_t transmitted = timestampToMillis(packet + NTP_TRANSMIT);
+  uint32_t held = transmitted > received ? (uint32_t) (transmitted - received) : 0;
+  uint32_t delay = roundTrip > held ? roundTrip - held : 0;
+
+  // The reply took about half the delay to get here
+  uint64_t now = transmitted + delay / 2;
+  // Unsigned arithmetic also handles NTP era 1, which starts in 2036
+  uint32_t epoch = (uint32_t) (now / 1000) - NTP_UNIX_OFFSET;
+  clock.set(epoch, now % 1000);
+
+  lastDelay = delay;
+  current = -1;
+  return true;
+}
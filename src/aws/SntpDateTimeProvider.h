@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2017 Tomas Nilsson (joekickass)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *    http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SNTPDATETIMEPROVIDER_H_
+#define SNTPDATETIMEPROVIDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aws-sdk-arduino/DeviceIndependentInterfaces.h"
+#include "aws/DateTime.h"
+#include "aws_iot_config.h"
+
+/* Size of an SNTP packet without extension fields or authenticator */
+static constexpr int SNTP_PACKET_LEN = 48;
+
+/*
+ * Datagram transport used by SntpDateTimeProvider, e.g. ESP8266UdpTransport.
+ * Neither function may block.
+ */
+class SntpTransport
+{
+  public:
+    virtual ~SntpTransport() {}
+
+    /* Send a datagram to host:port. Returns false if it could not be sent. */
+    virtual bool send(const char* host, uint16_t port, const uint8_t* data, size_t len) = 0;
+
+    /* Read a received datagram into buf. Returns its length, or 0 if there
+     * is none. Datagrams longer than len are truncated. */
+    virtual size_t receive(uint8_t* buf, size_t len) = 0;
+};
+
+/*
+ * SntpDateTimeProvider
+ *
+ * Gets the time from NTP servers (RFC 4330) without blocking. A query is
+ * sent to one server at a time. If it does not answer within the timeout,
+ * the next one is asked. The reply is handled by poll(), which should be
+ * called regularly, e.g. from loop(). getDateTime() also calls it.
+ *
+ * Half the round trip delay is added to the server time, so the error is
+ * bounded by the asymmetry of the network path rather than its latency.
+ *
+ * Between syncs the time is derived from millis(), see UtcClock.
+ *
+ * Usage:
+ *  ESP8266UdpTransport udp;
+ *  SntpDateTimeProvider dtp(udp);
+ *  dtp.addServer("pool.ntp.org");
+ *  dtp.addServer("time.nist.gov");
+ *  ...
+ *  while (!dtp.isSynced()) { dtp.poll(); yield(); }
+ */
+class SntpDateTimeProvider : public IDateTimeProvider
+{
+  public:
+    SntpDateTimeProvider(SntpTransport& transport);
+
+    /* Add a server, tried in the order added. The host name is not copied.
+     * Returns false if there already are AWS_IOT_SNTP_MAX_SERVERS. */
+    bool addServer(const char* host, uint16_t port = 123);
+
+    /* Send a query if one is due, handle replies and timeouts */
+    void poll();
+
+    /* Send a query on the next poll(), even if the time is known */
+    void requestSync();
+
+    /* Return true once the time has been received from a server */
+    bool isSynced();
+
+    /* Return true while waiting for a reply */
+    bool isQuerying();
+
+    /* Set how often (ms) the time is synced. 0 means never after the first
+     * successful sync. Defaults to AWS_IOT_TIME_RESYNC_INTERVAL. */
+    void setResyncInterval(unsigned long ms);
+
+    /* Set how long (ms) to wait for a reply before asking the next server.
+     * Defaults to AWS_IOT_SNTP_TIMEOUT. */
+    void setTimeout(unsigned long ms);
+
+    /* Round trip delay (ms) of the last successful query */
+    unsigned long getLastDelay();
+
+    /* Retrieve the current GMT date and time in yyyyMMddHHmmss format. Never
+     * blocks. Until the first sync it is 20120101000000. */
+    virtual const char* getDateTime(void);
+
+    /* Return true if the sync function requires the current time as in
+     * argument. */
+    virtual bool syncTakesArg(void);
+
+    /* Called if AWS Service reports in accurate time. Sets the provider to
+     * dt, the current GMT date and time in yyyyMMddHHmmss format. If dt is
+     * null or not valid, a query is sent on the next poll(), even within
+     * the re-sync interval. A burst of rejections only causes one query: none
+     * is sent within AWS_IOT_TIME_SYNC_RETRY_INTERVAL of the last one. */
+    virtual void sync(const char* dt);
+
+  private:
+
+    struct Server
+    {
+      const char* host;
+      uint16_t port;
+    };
+
+    SntpTransport& transport;
+
+    Server servers[AWS_IOT_SNTP_MAX_SERVERS];
+    int numServers;
+
+    /* Server queried, -1 if no query is in progress */
+    int current;
+
+    /* Transmit timestamp of the query, echoed by the server */
+    uint32_t cookie[2];
+
+    /* millis() when the query was sent */
+    unsigned long sentAt;
+
+    /* millis() when the last round over all servers started */
+    unsigned long lastAttempt;
+    bool attempted;
+    bool syncRequested;
+
+    unsigned long resyncInterval;
+    unsigned long timeout;
+    unsigned long lastDelay;
+
+    UtcClock clock;
+
+    /* DateTime in yyyyMMddHHmmss format, and its epoch */
+    char dateTime[DATE_TIME_LEN + 1];
+    uint32_t formatted;
+
+    /* Return true if it is time to start a new round of queries */
+    bool needsSync();
+
+    /* Send a query to servers[index]. Returns false if it failed. */
+    bool sendQuery(int index);
+
+    /* Ask the next server, or give up if all have been asked */
+    void nextServer();
+
+    /* Handle a reply. Returns true if it was valid and the clock was set. */
+    bool handleReply(const uint8_t* packet, size_t len);
+};
+
+#endif
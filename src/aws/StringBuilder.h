@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2017 Tomas Nilsson (joekickass)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *    http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef STRINGBUILDER_H_
+#define STRINGBUILDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * StringBuilder
+ *
+ * Bounded, append-only string builder on top of a caller provided buffer.
+ * Keeps track of its own length, so appending is linear in the number of
+ * appended chars and never rescans the buffer. The buffer is always null
+ * terminated.
+ *
+ * Appending more than fits never writes past the buffer. Instead the
+ * builder is marked as overflowed and all further appends are ignored, which
+ * is checked once with ok() when done.
+ */
+class StringBuilder
+{
+  public:
+    /* Capacity is the size of buf, including terminating null char */
+    StringBuilder(char* buf, size_t capacity) :
+      buf(buf),
+      capacity(capacity),
+      len(0),
+      overflow(capacity == 0)
+    {
+      if (capacity > 0) {
+        buf[0] = '\0';
+      }
+    }
+
+    StringBuilder& append(const char* str, size_t n)
+    {
+      if (overflow || len + n + 1 > capacity) {
+        overflow = true;
+        return *this;
+      }
+      memcpy(buf + len, str, n);
+      len += n;
+      buf[len] = '\0';
+      return *this;
+    }
+
+    StringBuilder& append(const char* str)
+    {
+      return append(str, strlen(str));
+    }
+
+    StringBuilder& append(char c)
+    {
+      return append(&c, 1);
+    }
+
+    /* Append the decimal representation of value */
+    StringBuilder& append(unsigned int value)
+    {
+      char digits[10];
+      size_t n = 0;
+      do {
+        digits[sizeof(digits) - 1 - n++] = '0' + value % 10;
+        value /= 10;
+      } while (value > 0);
+      return append(digits + sizeof(digits) - n, n);
+    }
+
+    /* Append data as lower case hexadecimal, two chars per byte */
+    StringBuilder& appendHex(const uint8_t* data, size_t n)
+    {
+      static const char dec2hex[16 + 1] = "0123456789abcdef";
+      if (overflow || len + 2 * n + 1 > capacity) {
+        overflow = true;
+        return *this;
+      }
+      for (size_t i = 0; i < n; ++i) {
+        buf[len++] = dec2hex[data[i] >> 4];
+        buf[len++] = dec2hex[data[i] & 15];
+      }
+      buf[len] = '\0';
+      return *this;
+    }
+
+    /* Length of the string built so far (not including terminating null char) */
+    size_t length() const
+    {
+      return len;
+    }
+
+    const char* c_str() const
+    {
+      return buf;
+    }
+
+    /* Return false if anything did not fit in the buffer */
+    bool ok() const
+    {
+      return !overflow;
+    }
+
+  private:
+    char* buf;
+    size_t capacity;
+    size_t len;
+    bool overflow;
+};
+
+#endif
@@ -28,10 +28,28 @@
 #define AWS_IOT_MQTT_CLIENT_ID         "esp8266-id" ///< MQTT client ID should be unique for every device
 #define AWS_IOT_MY_THING_NAME          "esp8266-name" ///< Thing Name of the Shadow this device is associated with
 
+// Websocket config
+#define AWS_IOT_PRESIGNED_URL_EXPIRES 86400 ///< Lifetime in seconds of the sigv4 presigned websocket URL (X-Amz-Expires), at most 604800. A shorter lifetime means more frequent re-signing
+#define AWS_IOT_WS_SPSC_RECEIVE_BUFFER 0 ///< 1 buffers received data in a lock-free SpscByteBuffer, for running the websocket (AWSWebSocketClientAdapter::loop()) on another thread than the MQTT client. Frame mode and OVERFLOW_GROW are not available then
+#define AWS_IOT_WS_PUMP_BUDGET 5000 ///< Microseconds AWSMqttClient::yield() spends at most receiving from the websocket before handing the data to the MQTT client
+#define AWS_IOT_PRESIGNED_URL_REFRESH_MARGIN 300 ///< The presigned URL is re-signed in the background this many seconds before it expires, capped at half the lifetime
+
+// Time config
+#define AWS_IOT_TIME_RESYNC_INTERVAL 21600000 ///< Milliseconds between syncs with the time server. In between, the time is derived from millis(). 0 syncs only once
+#define AWS_IOT_TIME_SYNC_RETRY_INTERVAL 10000 ///< Milliseconds to wait before contacting the time server again after a failed sync
+#define AWS_IOT_SNTP_MAX_SERVERS 3 ///< Maximum number of NTP servers of a SntpDateTimeProvider
+#define AWS_IOT_SNTP_TIMEOUT 1000 ///< Milliseconds to wait for a NTP reply before asking the next server
+#define AWS_IOT_SNTP_LOCAL_PORT 2390 ///< Local UDP port used by ESP8266UdpTransport
+
 // MQTT config
 #define AWS_IOT_MQTT_TX_BUF_LEN 512 ///< Any time a message is sent out through the MQTT layer. The message is copied into this buffer anytime a publish is done. This will also be used in the case of Thing Shadow
-#define AWS_IOT_MQTT_RX_BUF_LEN 512 ///< Any message that comes into the device should be less than this buffer size. If a received message is bigger than this buffer size the message will be dropped.
-#define AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS 5 ///< Maximum number of topic filters the MQTT client can handle at any given time. This should be increased appropriately when using Thing Shadow
+#define AWS_IOT_MQTT_RX_BUF_LEN 512 ///< Any message that comes into the device should be less than this buffer size. If a received message is bigger than this buffer size the message will be dropped, a QoS 1 one is still acknowledged.
+#define AWS_IOT_MQTT_COMMAND_TIMEOUT 30000 ///< Milliseconds the MQTT client waits for the reply to a command, e.g. CONNACK on connect
+#define AWS_IOT_MQTT_MAX_INFLIGHT 16 ///< Largest window of QoS 1 messages AWSMqttClient::publishAsync() can have waiting for a PUBACK
+#define AWS_IOT_MQTT_PUBLISH_WINDOW 4 ///< Default window of QoS 1 messages waiting for a PUBACK, see AWSMqttClient::setPublishWindow()
+#define AWS_IOT_MQTT_PUBACK_TIMEOUT 5000 ///< Milliseconds to wait for a PUBACK before a QoS 1 message is sent again with DUP set
+#define AWS_IOT_MQTT_PUBLISH_RETRIES 3 ///< Number of times a QoS 1 message is sent again before it is reported as failed
+#define AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS 5 ///< Maximum number of topic filters the MQTT client can handle at any given time. This should be increased appropriately when using Thing Shadow. Only bounds the number of subscriptions, messages are matched in a TopicTrie
 
 // Thing Shadow specific config
 #define SHADOW_MAX_SIZE_OF_RX_BUFFER AWS_IOT_MQTT_RX_BUF_LEN+1 ///< Maximum size of the SHADOW buffer to store the received Shadow message
@@ -17,9 +17,13 @@
 #include "config/AWSConnectionParams.h"
 #include "aws_iot_config.h"
 
-AWSConnectionParams::AWSConnectionParams(AwsIotSigv4& sigv4) :
-  sigv4(sigv4)
+AWSConnectionParams::AWSConnectionParams(AwsIotSigv4& sigv4, const char* clientId) :
+  sigv4(sigv4),
+  path(0),
+  pathSignedAt(0)
 {
+  this->clientId[0] = '\0';
+  setClientId(clientId);
 }
 
 AWSConnectionParams::~AWSConnectionParams()
@@ -39,14 +43,83 @@ unsigned int AWSConnectionParams::getPort()
   return sigv4.awsPort;
 }
 
+/*
+ * Returns the cached presigned path. It is normally kept fresh by yield(),
+ * so signing only happens here if yield() has not been called in time.
+ */
 char* AWSConnectionParams::getPath()
 {
-  if (path == 0) {
-    sigv4.createPath(&path);
+  if (needsRefresh()) {
+    refreshPath();
   }
   return path;
 }
 
+void AWSConnectionParams::yield()
+{
+  if (needsRefresh()) {
+    refreshPath();
+  }
+}
+
+void AWSConnectionParams::setUrlExpiry(unsigned long seconds)
+{
+  sigv4.setExpires(seconds);
+  if (path != 0) {
+    delete[] path;
+    path = 0;
+  }
+}
+
+bool AWSConnectionParams::needsRefresh()
+{
+  // Unsigned arithmetic handles millis() wraparound
+  return path == 0 || (millis() - pathSignedAt) >= getRefreshAfter();
+}
+
+void AWSConnectionParams::refreshPath()
+{
+  char* newPath;
+  if (sigv4.createPath(&newPath) == 0) {
+    // Keep the old path, it may still be valid
+    return;
+  }
+  if (path != 0) {
+    delete[] path;
+  }
+  path = newPath;
+  pathSignedAt = millis();
+}
+
+unsigned long AWSConnectionParams::getRefreshAfter()
+{
+  unsigned long expires = sigv4.getExpires();
+  unsigned long margin = AWS_IOT_PRESIGNED_URL_REFRESH_MARGIN;
+  if (margin > expires / 2) {
+    margin = expires / 2;
+  }
+  return (expires - margin) * 1000;
+}
+
+/*
+ * AWS rejects the handshake if the signature is expired or not yet valid,
+ * which happens if the clock is off by more than 5 minutes. There is no way
+ * to tell this apart from other rejections, and the websocket library does
+ * not pass on the response body with the server time, so the provider is
+ * asked to query its time server. It does so once per burst of rejections,
+ * not on every reconnect of a server that keeps rejecting the handshake.
+ * A provider that blocks (ESP8266DateTimeProvider) has the time before the
+ * URL is re-signed here, SntpDateTimeProvider by the next reconnect.
+ */
+bool AWSConnectionParams::handshakeRejected(const char* reason)
+{
+  sigv4.syncTime(reason);
+
+  char* oldPath = path;
+  refreshPath();
+  return path != oldPath;
+}
+
 char* AWSConnectionParams::getFingerprint()
 {
   return "";
@@ -68,5 +141,14 @@ unsigned int AWSConnectionParams::getVersion()
 }
 char* AWSConnectionParams::getClientId()
 {
-  return AWS_IOT_MQTT_CLIENT_ID;
+  return clientId;
+}
+
+bool AWSConnectionParams::setClientId(const char* id)
+{
+  if (id == 0 || id[0] == '\0' || strlen(id) > MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES) {
+    return false;
+  }
+  strcpy(clientId, id);
+  return true;
 }
@@ -20,11 +20,14 @@
 #include "ws/WebSocketClientAdapter.h"
 #include "mqtt/MqttClient.h"
 #include "aws/AwsIotSigv4.h"
+#include "aws_iot_config.h"
 
 class AWSConnectionParams : public WebSocketParams, public MqttParams
 {
   public:
-    AWSConnectionParams(AwsIotSigv4& sigv4);
+    // clientId must be unique per connection, two clients with the same ID
+    // disconnect each other
+    AWSConnectionParams(AwsIotSigv4& sigv4, const char* clientId = AWS_IOT_MQTT_CLIENT_ID);
     ~AWSConnectionParams();
 
     // TCP params
@@ -37,15 +40,42 @@ class AWSConnectionParams : public WebSocketParams, public MqttParams
     char* getProtocol();
     bool useSsl();
 
+    // Corrects the time (see AwsIotSigv4::syncTime()) and re-signs the URL
+    bool handshakeRejected(const char* reason);
+
     // MQTT params
     unsigned int getVersion();
     char* getClientId();
 
+    // Set the MQTT client ID used on the next connect. The ID is copied.
+    // Returns false, keeping the old ID, if it is empty or longer than
+    // MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES.
+    bool setClientId(const char* id);
+
+    // Re-signs the presigned URL if it is about to expire
+    void yield();
+
+    // Set lifetime of the presigned URL in seconds. Drops the current URL.
+    void setUrlExpiry(unsigned long seconds);
+
+    // Returns true if the cached URL is missing or about to expire
+    bool needsRefresh();
+
+    // Sign a new URL now, replacing the cached one
+    void refreshPath();
+
   private:
 
     AwsIotSigv4 sigv4;
 
+    char clientId[MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES + 1];
+
+    // Cached presigned path, signed at pathSignedAt (millis())
     char* path;
+    unsigned long pathSignedAt;
+
+    // Time (ms) after signing when the path is considered stale
+    unsigned long getRefreshAfter();
 };
 
 #endif
@@ -16,45 +16,106 @@
 
 #include "mqtt/MqttClient.h"
 
-// Keep a global reference of the instance to use in FPT callback
-AWSMqttClient* AWSMqttClient::instance = NULL;
-
 MqttParams::~MqttParams() {}
 
 AWSMqttClient::AWSMqttClient(AWSWebSocketClientAdapter& wsAdapter, MqttParams& p) :
   adapter(wsAdapter),
-  ipstack(adapter),
-  client(ipstack),
-  params(p)
+  filter(wsAdapter, pubackReceived, publishReceived, this),
+  ipstack(filter),
+  client(ipstack, AWS_IOT_MQTT_COMMAND_TIMEOUT),
+  params(p),
+  inFlightCount(0),
+  publishWindow(AWS_IOT_MQTT_PUBLISH_WINDOW),
+  // Paho numbers its packets from 1 up, use the upper half
+  lastPacketId(0x7fff),
+  connectState(CONNECT_IDLE),
+  onConnect(NULL),
+  connectResult(-1)
 {
-  AWSMqttClient::instance = this;
-  for(int i = 0; i < AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS; ++i) {
-    SubscriptionCallbacks[i].topic = 0;
-    SubscriptionCallbacks[i].cb = NULL;
+  // A packet is always written completely before it is flushed, see
+  // flush() calls below. Room for the largest packet.
+  adapter.setWriteBufferSize(AWS_IOT_MQTT_TX_BUF_LEN);
+
+  for (int i = 0; i < AWS_IOT_MQTT_MAX_INFLIGHT; ++i) {
+    inFlight[i].id = 0;
+    inFlight[i].packet = NULL;
   }
 }
 
 AWSMqttClient::~AWSMqttClient()
 {
+  for (int i = 0; i < AWS_IOT_MQTT_MAX_INFLIGHT; ++i) {
+    free(inFlight[i].packet);
+  }
 }
 
 int AWSMqttClient::connect()
+{
+  beginConnect();
+
+  ConnectState state;
+  while ((state = poll()) != CONNECT_DONE && state != CONNECT_FAILED) {
+    delay(10);
+  }
+  return connectResult;
+}
+
+void AWSMqttClient::beginConnect(connectCallback cb)
 {
   // make sure we're stopped
   adapter.stop();
+  filter.reset();
 
-  char* host = params.getHost();
-  int port = params.getPort();
-  int success = ipstack.connect(host, port);
-  if (!success) {
-    return -1;
+  // Clean session, the server forgets unacknowledged messages
+  failPublishes(MQTT::FAILURE);
+
+  onConnect = cb;
+  connectResult = -1;
+  connectState = CONNECT_WEBSOCKET;
+  adapter.beginConnect();
+}
+
+AWSMqttClient::ConnectState AWSMqttClient::poll()
+{
+  switch (connectState) {
+    case CONNECT_WEBSOCKET:
+      switch (adapter.pollConnect()) {
+        case AWSWebSocketClientAdapter::CONNECT_DONE:
+          // CONNECT on the next poll, to give the caller a turn in between
+          connectState = CONNECT_MQTT;
+          break;
+        case AWSWebSocketClientAdapter::CONNECT_PENDING:
+          break;
+        default:
+          connectDone(-1);
+          break;
+      }
+      break;
+    case CONNECT_MQTT: {
+      MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+      data.MQTTVersion = params.getVersion();
+      data.clientID.cstring = params.getClientId();
+      connectDone(client.connect(data));
+      break;
+    }
+    default:
+      break;
   }
+  return connectState;
+}
 
-  MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
-  data.MQTTVersion = params.getVersion();
-  data.clientID.cstring = params.getClientId();
+void AWSMqttClient::setConnectTimeout(unsigned long ms)
+{
+  adapter.setConnectTimeout(ms);
+}
 
-  return client.connect(data);
+void AWSMqttClient::connectDone(int rc)
+{
+  connectResult = rc;
+  connectState = rc == 0 ? CONNECT_DONE : CONNECT_FAILED;
+  if (onConnect != NULL) {
+    onConnect(rc);
+  }
 }
 
 bool AWSMqttClient::isConnected()
@@ -62,96 +123,457 @@ bool AWSMqttClient::isConnected()
   return adapter.connected() && client.isConnected();
 }
 
-void AWSMqttClient::yield()
+void AWSMqttClient::yield(unsigned long timeoutMs)
 {
-  client.yield();
+#if !AWS_IOT_WS_SPSC_RECEIVE_BUFFER
+  // Else the receiving thread pumps
+  adapter.pump(AWS_IOT_WS_PUMP_BUDGET);
+#endif
+  client.yield(timeoutMs);
+  processPublishes();
+  adapter.flush();
+  params.yield();
 }
 
 void AWSMqttClient::disconnect()
 {
   client.disconnect();
+  adapter.flush();
+  failPublishes(MQTT::FAILURE);
 }
 
 int AWSMqttClient::publish(const char* topic, const char* payload, unsigned int qos, bool retained)
 {
-  // Need a non-const, null terminated string
-  char pl[strlen(payload) + 1];
-  snprintf(pl, strlen(payload) + 1, "%s", payload);
-  MQTT::QoS qs = static_cast<MQTT::QoS>(qos); // Assuming default enum values
-  return client.publish(topic, pl, strlen(payload) + 1, qs, retained);
+  return publish(topic, (const uint8_t*) payload, strlen(payload) + 1, qos, retained);
 }
 
-int AWSMqttClient::subscribe(const char* topic, unsigned int qos, subscriptionCallback cb)
+int AWSMqttClient::publish(const char* topic, const uint8_t* data, size_t len, unsigned int qos, bool retained)
 {
+  if (qos == MQTT::QOS0) {
+    PublishSegment segment = { data, len };
+    return publishDirect(topic, &segment, 1, retained);
+  }
+
+  if (qos == MQTT::QOS1) {
+    PublishSegment segment = { data, len };
+    return publishAcked(topic, &segment, 1, retained);
+  }
+
+  // Paho does not modify the payload, it copies it to its send buffer
   MQTT::QoS qs = static_cast<MQTT::QoS>(qos); // Assuming default enum values
-  addCallback(topic, cb);
-  return client.subscribe(topic, qs,
-    // Need to use a lamda w.o. capture list since MQTT::Client.messageHandler is PTF
-    [](MQTT::MessageData& md) {
-      // c strings from underlying implementation are not null terminated. Create new.
-      char topic[md.topicName.lenstring.len + 1];
-      snprintf(topic, md.topicName.lenstring.len + 1, "%s", md.topicName.lenstring.data);
-      char msg[md.message.payloadlen + 1];
-      snprintf(msg, md.message.payloadlen + 1, "%s", (char*)md.message.payload);
-      instance->handleCallback(topic, msg);
+  int rc = client.publish(topic, (void*) data, len, qs, retained);
+  adapter.flush();
+  return rc;
+}
+
+int AWSMqttClient::publish(const char* topic, const PublishSegment* segments, size_t count, unsigned int qos, bool retained)
+{
+  if (qos == MQTT::QOS0) {
+    return publishDirect(topic, segments, count, retained);
+  }
+  if (qos == MQTT::QOS1) {
+    return publishAcked(topic, segments, count, retained);
+  }
+
+  // Paho's publish() takes the payload in one piece
+  size_t len = 0;
+  for (size_t i = 0; i < count; ++i) {
+    len += segments[i].len;
+  }
+  uint8_t* data = (uint8_t*) malloc(len > 0 ? len : 1);
+  if (data == NULL) {
+    return MQTT::FAILURE;
+  }
+  size_t offset = 0;
+  for (size_t i = 0; i < count; ++i) {
+    memcpy(data + offset, segments[i].data, segments[i].len);
+    offset += segments[i].len;
+  }
+  int rc = publish(topic, data, len, qos, retained);
+  free(data);
+  return rc;
+}
+
+/*
+ * A QoS 0 PUBLISH has no packet identifier and needs no reply, so Paho
+ * keeps no state for it and the packet can be written without Paho. The
+ * adapter's write buffer collects the pieces into one websocket frame, if
+ * they fit.
+ */
+int AWSMqttClient::publishDirect(const char* topic, const PublishSegment* segments, size_t count, bool retained)
+{
+  if (!client.isConnected()) {
+    return MQTT::FAILURE;
+  }
+
+  size_t topicLen = strlen(topic);
+  size_t remainingLen = 2 + topicLen;
+  for (size_t i = 0; i < count; ++i) {
+    remainingLen += segments[i].len;
+  }
+
+  uint8_t header[5 + 2];
+  int headerLen = publishHeader(header, topicLen, remainingLen, MQTT::QOS0, retained);
+  if (headerLen == 0) {
+    return MQTT::FAILURE;
+  }
+
+  bool ok = adapter.write(header, headerLen) == (size_t) headerLen &&
+            adapter.write((const uint8_t*) topic, topicLen) == topicLen;
+  for (size_t i = 0; ok && i < count; ++i) {
+    ok = segments[i].len == 0 || adapter.write(segments[i].data, segments[i].len) == segments[i].len;
+  }
+  adapter.flush();
+  return ok ? MQTT::SUCCESS : MQTT::FAILURE;
+}
+
+int AWSMqttClient::publishAcked(const char* topic, const PublishSegment* segments, size_t count, bool retained)
+{
+  // Set by the callback, from yield()
+  const int pending = 1;
+  int result = pending;
+
+  // Wait for room in the window, and then for the PUBACK, as long as Paho
+  // waits for the reply to a command. Resends happen in between.
+  Countdown timer(AWS_IOT_MQTT_COMMAND_TIMEOUT);
+  int id;
+  while ((id = publishAsync(topic, segments, count, retained,
+                            [](unsigned short, int rc, void* arg) { *(int*) arg = rc; },
+                            &result)) == 0) {
+    if (timer.expired()) {
+      return MQTT::FAILURE;
+    }
+    yield(10);
+  }
+  if (id < 0) {
+    return id;
+  }
+  while (result == pending) {
+    if (timer.expired()) {
+      // Give up on it, result goes out of scope. A late PUBACK is ignored.
+      InFlight* f = findInFlight(id);
+      if (f != NULL) {
+        f->cb = NULL;
+        completePublish(*f, MQTT::FAILURE);
+      }
+      return MQTT::FAILURE;
     }
-  );
+    yield(10);
+  }
+  return result;
 }
 
-void AWSMqttClient::unsubscribe(const char *topic)
+int AWSMqttClient::publishHeader(uint8_t* header, size_t topicLen, size_t remainingLen, unsigned int qos, bool retained)
 {
-  removeCallback(topic);
-  client.unsubscribe(topic);
+  // Largest length the MQTT variable length encoding can represent
+  if (topicLen > 65535 || remainingLen > 268435455) {
+    return 0;
+  }
+
+  // Fixed header (at most 5 bytes) and topic length
+  header[0] = (PUBLISH << 4) | (qos << 1) | (retained ? 1 : 0);
+  int headerLen = 1 + MQTTPacket_encode(header + 1, remainingLen);
+  header[headerLen++] = topicLen >> 8;
+  header[headerLen++] = topicLen & 0xff;
+  return headerLen;
 }
 
-void AWSMqttClient::addCallback(const char* topic, subscriptionCallback cb)
+int AWSMqttClient::publishAsync(const char* topic, const uint8_t* data, size_t len, bool retained,
+                                publishCallback cb, void* arg)
 {
-  if (topic == NULL || cb == NULL) {
-    return;
+  PublishSegment segment = { data, len };
+  return publishAsync(topic, &segment, 1, retained, cb, arg);
+}
+
+/*
+ * The packet is kept until the PUBACK arrives, to be sent again if it
+ * doesn't. PacketFilter hands the PUBACK over before Paho sees it, and
+ * processPublishes() completes the message on the next yield().
+ */
+int AWSMqttClient::publishAsync(const char* topic, const PublishSegment* segments, size_t count, bool retained,
+                                publishCallback cb, void* arg)
+{
+  if (!isConnected()) {
+    return MQTT::FAILURE;
+  }
+  if (inFlightCount >= publishWindow) {
+    return 0;
   }
 
-  for(int i = 0; i < AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS; ++i) {
-    if (SubscriptionCallbacks[i].topic == 0) {
-      SubscriptionCallbacks[i].topic = topic;
-      SubscriptionCallbacks[i].cb = cb;
-      break;
+  InFlight* f = findInFlight(0);
+  size_t topicLen = strlen(topic);
+  size_t remainingLen = 2 + topicLen + 2;
+  for (size_t i = 0; i < count; ++i) {
+    remainingLen += segments[i].len;
+  }
+  uint8_t header[5 + 2];
+  int headerLen = publishHeader(header, topicLen, remainingLen, MQTT::QOS1, retained);
+  if (f == NULL || headerLen == 0) {
+    return MQTT::FAILURE;
+  }
+
+  size_t packetLen = headerLen - 2 + remainingLen;
+  uint8_t* packet = (uint8_t*) malloc(packetLen);
+  if (packet == NULL) {
+    return MQTT::FAILURE;
+  }
+  unsigned short id = nextPacketId();
+  uint8_t* p = packet;
+  memcpy(p, header, headerLen);
+  p += headerLen;
+  memcpy(p, topic, topicLen);
+  p += topicLen;
+  *p++ = id >> 8;
+  *p++ = id & 0xff;
+  for (size_t i = 0; i < count; ++i) {
+    memcpy(p, segments[i].data, segments[i].len);
+    p += segments[i].len;
+  }
+
+  bool ok = adapter.write(packet, packetLen) == packetLen;
+  adapter.flush();
+  if (!ok) {
+    free(packet);
+    return MQTT::FAILURE;
+  }
+
+  f->id = id;
+  f->acked = false;
+  f->retries = 0;
+  f->sentAt = millis();
+  f->packet = packet;
+  f->len = packetLen;
+  f->cb = cb;
+  f->arg = arg;
+  inFlightCount++;
+  return id;
+}
+
+void AWSMqttClient::setPublishWindow(size_t window)
+{
+  if (window < 1) {
+    window = 1;
+  }
+  publishWindow = window < AWS_IOT_MQTT_MAX_INFLIGHT ? window : AWS_IOT_MQTT_MAX_INFLIGHT;
+}
+
+size_t AWSMqttClient::getPublishesInFlight()
+{
+  return inFlightCount;
+}
+
+unsigned short AWSMqttClient::nextPacketId()
+{
+  do {
+    lastPacketId = lastPacketId == 0xffff ? 0x8000 : lastPacketId + 1;
+  } while (findInFlight(lastPacketId) != NULL);
+  return lastPacketId;
+}
+
+AWSMqttClient::InFlight* AWSMqttClient::findInFlight(unsigned short id)
+{
+  for (int i = 0; i < AWS_IOT_MQTT_MAX_INFLIGHT; ++i) {
+    if (inFlight[i].id == id) {
+      return &inFlight[i];
     }
   }
+  return NULL;
+}
+
+bool AWSMqttClient::pubackReceived(unsigned short id, void* arg)
+{
+  AWSMqttClient* self = (AWSMqttClient*) arg;
+  InFlight* f = id != 0 ? self->findInFlight(id) : NULL;
+  if (f == NULL) {
+    // Paho's own, or a late duplicate. Paho ignores those.
+    return false;
+  }
+  f->acked = true;
+  return true;
 }
 
-void AWSMqttClient::removeCallback(const char* topic)
+void AWSMqttClient::processPublishes()
 {
-  if (topic == NULL) {
+  if (inFlightCount == 0) {
+    return;
+  }
+  if (!isConnected()) {
+    failPublishes(MQTT::FAILURE);
     return;
   }
 
-  for(int i = 0; i < AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS; ++i) {
-    if (strcmp(SubscriptionCallbacks[i].topic, topic) == 0) {
-      SubscriptionCallbacks[i].topic = 0;
-      SubscriptionCallbacks[i].cb = NULL;
-      break;
+  unsigned long now = millis();
+  for (int i = 0; i < AWS_IOT_MQTT_MAX_INFLIGHT; ++i) {
+    InFlight& f = inFlight[i];
+    if (f.id == 0) {
+      continue;
+    }
+    if (f.acked) {
+      completePublish(f, MQTT::SUCCESS);
+    } else if ((uint32_t) (now - f.sentAt) >= AWS_IOT_MQTT_PUBACK_TIMEOUT) {
+      if (f.retries >= AWS_IOT_MQTT_PUBLISH_RETRIES) {
+        completePublish(f, MQTT::FAILURE);
+        continue;
+      }
+      // Same packet identifier, with DUP set
+      f.packet[0] |= 0x08;
+      adapter.write(f.packet, f.len);
+      f.retries++;
+      f.sentAt = now;
+    }
+  }
+}
+
+void AWSMqttClient::failPublishes(int rc)
+{
+  for (int i = 0; i < AWS_IOT_MQTT_MAX_INFLIGHT; ++i) {
+    if (inFlight[i].id != 0) {
+      completePublish(inFlight[i], rc);
     }
   }
 }
 
-subscriptionCallback AWSMqttClient::getCallback(const char* topic)
+void AWSMqttClient::completePublish(InFlight& f, int rc)
+{
+  unsigned short id = f.id;
+  publishCallback cb = f.cb;
+  void* arg = f.arg;
+
+  // Free first, the callback may publish again
+  free(f.packet);
+  f.packet = NULL;
+  f.id = 0;
+  inFlightCount--;
+
+  if (cb != NULL) {
+    cb(id, rc, arg);
+  }
+}
+
+int AWSMqttClient::subscribe(const char* topic, unsigned int qos, subscriptionCallback cb)
 {
-  if (topic == NULL) {
-    return NULL;
+  return subscribe(topic, qos, cb, NULL);
+}
+
+int AWSMqttClient::subscribe(const char* topic, unsigned int qos, messageCallback cb)
+{
+  return subscribe(topic, qos, NULL, cb);
+}
+
+int AWSMqttClient::subscribe(const char* topic, unsigned int qos, subscriptionCallback cb, messageCallback mcb)
+{
+  MessageHandler handler = { cb, mcb };
+  bool added;
+  if ((cb == NULL && mcb == NULL) || !handlers.add(topic, handler, &added)) {
+    return MQTT::FAILURE;
+  }
+
+  MQTT::QoS qs = static_cast<MQTT::QoS>(qos); // Assuming default enum values
+  int rc = client.subscribe(topic, qs, NULL);
+  adapter.flush();
+
+  // A failed re-subscribe keeps an earlier registration of the same handler
+  if (rc != MQTT::SUCCESS && added) {
+    handlers.remove(topic, handler);
   }
+  return rc;
+}
+
+void AWSMqttClient::unsubscribe(const char *topic)
+{
+  handlers.removeAll(topic);
+  client.unsubscribe(topic);
+  adapter.flush();
+}
+
+/*
+ * Paho's message handlers are plain functions without context, so the
+ * PUBLISHes are taken out of the stream by the filter before Paho reads
+ * them, and handled here: dispatched to the callbacks, and acknowledged
+ * after that at QoS 1, as Paho would.
+ */
+void AWSMqttClient::publishReceived(uint8_t* packet, size_t len, size_t total, void* arg)
+{
+  AWSMqttClient* self = (AWSMqttClient*) arg;
+  int qos = (packet[0] >> 1) & 3;
+  unsigned short id = 0;
 
-  for(int i = 0; i < AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS; ++i) {
-    if (strcmp(SubscriptionCallbacks[i].topic, topic) == 0) {
-      return SubscriptionCallbacks[i].cb;
+  if (len == total) {
+    MQTTString topic = MQTTString_initializer;
+    unsigned char dup;
+    unsigned char retained;
+    unsigned char* payload;
+    int payloadLen;
+    if (MQTTDeserialize_publish(&dup, &qos, &retained, &id, &topic, &payload, &payloadLen,
+                                packet, len) != 1) {
+      return;
     }
+    MQTT::Message message;
+    message.qos = static_cast<MQTT::QoS>(qos);
+    message.retained = retained;
+    message.dup = dup;
+    message.id = id;
+    message.payload = payload;
+    message.payloadlen = payloadLen;
+    MQTT::MessageData md(topic, message);
+    self->handleMessage(md);
+  } else if (qos == MQTT::QOS1 && !publishId(packet, len, &id)) {
+    // Not even the packet identifier fit
+    return;
   }
-  return NULL;
+
+  // Too large ones are dropped, but still acknowledged, they would only
+  // come again
+  if (qos == MQTT::QOS1) {
+    uint8_t ack[4] = { PUBACK << 4, 2, (uint8_t) (id >> 8), (uint8_t) (id & 0xff) };
+    self->adapter.write(ack, sizeof(ack));
+    self->adapter.flush();
+  }
+}
+
+bool AWSMqttClient::publishId(const uint8_t* packet, size_t len, unsigned short* id)
+{
+  // Fixed header, topic, packet identifier
+  size_t i = 1;
+  while (i < len && (packet[i] & 0x80) != 0) {
+    i++;
+  }
+  i++;
+  if (i + 2 > len) {
+    return false;
+  }
+  i += 2 + ((packet[i] << 8) | packet[i + 1]);
+  if (i + 2 > len) {
+    return false;
+  }
+  *id = (packet[i] << 8) | packet[i + 1];
+  return true;
 }
 
-void AWSMqttClient::handleCallback(const char* topic, const char* msg)
+void AWSMqttClient::handleMessage(MQTT::MessageData& md)
 {
-  subscriptionCallback cb = getCallback(topic);
-  if (topic != NULL && cb != NULL) {
-    cb(topic, msg);
+  handlers.match(md.topicName.lenstring.data, md.topicName.lenstring.len, deliver, &md);
+}
+
+void AWSMqttClient::deliver(const MessageHandler& handler, void* arg)
+{
+  MQTT::MessageData& md = *(MQTT::MessageData*) arg;
+
+  // Topic and payload point into the filter's packet buffer
+  const char* topic = md.topicName.lenstring.data;
+  size_t topicLen = md.topicName.lenstring.len;
+  const uint8_t* payload = (const uint8_t*) md.message.payload;
+  size_t len = md.message.payloadlen;
+
+  if (handler.mcb != NULL) {
+    handler.mcb(topic, topicLen, payload, len, md.message.qos, md.message.retained, md.message.dup);
+  } else {
+    // c strings from underlying implementation are not null terminated. Create new.
+    char t[topicLen + 1];
+    memcpy(t, topic, topicLen);
+    t[topicLen] = '\0';
+    char msg[len + 1];
+    snprintf(msg, len + 1, "%s", (const char*) payload);
+    handler.cb(t, msg);
   }
 }
@@ -21,6 +21,8 @@
 #include <Countdown.h>
 #include <MQTTClient.h>
 
+#include "mqtt/PacketFilter.h"
+#include "mqtt/TopicTrie.h"
 #include "ws/WebSocketClientAdapter.h"
 
 // TODO Refactor away config here
@@ -29,10 +31,24 @@
 // (const char* topic, const char* payload)
 typedef void (*subscriptionCallback) (const char*, const char*);
 
-struct {
-  const char* topic;
-  subscriptionCallback cb;
-} SubscriptionCallbacks[AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS];
+// (const char* topic, size_t topicLen, const uint8_t* payload, size_t len,
+//  unsigned int qos, bool retained, bool dup)
+// topic and payload point into the MQTT client's receive buffer and are only
+// valid during the call. topic is not null terminated.
+typedef void (*messageCallback) (const char*, size_t, const uint8_t*, size_t, unsigned int, bool, bool);
+
+// (int rc), 0 if connected, see AWSMqttClient::connect()
+typedef void (*connectCallback) (int);
+
+// (unsigned short id, int rc, void* arg), rc is 0 if the PUBACK arrived,
+// see AWSMqttClient::publishAsync()
+typedef void (*publishCallback) (unsigned short, int, void*);
+
+// Part of a payload, see AWSMqttClient::publish()
+struct PublishSegment {
+  const uint8_t* data;
+  size_t len;
+};
 
 /*
  * MqttParams provides connection parameters for the MqttClient
@@ -49,6 +65,10 @@ public:
   virtual unsigned int getVersion() =0;
   virtual char* getClientId()       =0;
   virtual ~MqttParams()             =0;
+
+  // Called from AWSMqttClient::yield(). Lets parameters do background work
+  // in idle time, e.g. re-sign a presigned URL before it expires.
+  virtual void yield()              {}
 };
 
 /**
@@ -56,7 +76,16 @@ public:
  *
  * Assumes WebSockets handles security using TLS.
  *
- * TODO: Also assumes null terminated c strings as payload (i.e. json data)
+ * Any number of clients can be used side by side, each with its own
+ * adapter and params (with its own client ID). They share no state.
+ *
+ * Received messages are dispatched by AWSMqttClient itself, to all callbacks
+ * with a matching topic filter (including + and # wildcards). They are
+ * taken out of the stream before Paho reads them, so Paho's keepalive timer
+ * is not reset by them either, see publish(). Messages larger than
+ * AWS_IOT_MQTT_RX_BUF_LEN are dropped. QoS 2 messages are left to Paho,
+ * which drops them (AWS IoT only supports QoS 0 and 1).
+ *
  * Some information on the AWS IoT Websocket+MQTT protocols
  * http://docs.aws.amazon.com/iot/latest/developerguide/protocols.html
  */
@@ -64,6 +93,15 @@ class AWSMqttClient {
 
   public:
 
+    // Progress of a connect started with beginConnect()
+    enum ConnectState {
+      CONNECT_IDLE,
+      CONNECT_WEBSOCKET,
+      CONNECT_MQTT,
+      CONNECT_DONE,
+      CONNECT_FAILED
+    };
+
     AWSMqttClient(AWSWebSocketClientAdapter& a, MqttParams& p);
     ~AWSMqttClient();
 
@@ -71,40 +109,175 @@ class AWSMqttClient {
     //Returns 0 if successful, or non-zero otherwise
     int connect();
 
+    // Start connecting without blocking. Call poll() from loop() until it
+    // returns CONNECT_DONE or CONNECT_FAILED, cb (if set) is then called
+    // with the same result as connect() returns. The websocket handshake
+    // is waited for over several polls. The TLS connect and the MQTT
+    // CONNECT/CONNACK exchange each block within one poll, the latter for
+    // at most AWS_IOT_MQTT_COMMAND_TIMEOUT.
+    void beginConnect(connectCallback cb = NULL);
+    ConnectState poll();
+
+    // Time (ms) to wait for the websocket handshake
+    void setConnectTimeout(unsigned long ms);
+
     bool isConnected();
 
-    void yield();
+    // Receive and handle messages for timeoutMs, resend unacknowledged
+    // publishes and report completed ones
+    void yield(unsigned long timeoutMs = 1000);
 
     void disconnect();
 
     // Publish to topic
     // Returns 0 if successful, or non-zero otherwise.
+    // Note that the terminating null char is sent as part of the payload.
     // TODO: Remove retained?
     int publish(const char* topic, const char* payload, unsigned int qos, bool retained);
 
-    // Subscribe to topic
+    // Publish len bytes of binary data. With QoS 0, the packet is written
+    // from data to the websocket, without Paho. It is still copied once:
+    // into the adapter's write buffer, or by arduinoWebSockets for pieces
+    // larger than that. QoS 1 is publishAsync() waiting for the result,
+    // which copies the packet to a buffer allocated until the PUBACK. It
+    // waits at most AWS_IOT_MQTT_COMMAND_TIMEOUT, like Paho does for a
+    // reply, including the wait for room in the window and resends. QoS 2 is
+    // copied to the MQTT client's send buffer and must fit in
+    // AWS_IOT_MQTT_TX_BUF_LEN.
+    //
+    // Paho only sees the QoS 2 packets. Its keepalive timer is not reset by
+    // QoS 0 and 1 publishes, so it sends a PINGREQ every keepalive interval
+    // even while these keep the connection busy. That costs one small
+    // packet per interval, the connection is kept alive either way.
+    int publish(const char* topic, const uint8_t* data, size_t len, unsigned int qos, bool retained);
+
+    // Publish a payload made of count segments, e.g. a header and a body,
+    // without joining them first. The copies are the same as for a payload
+    // in one piece, except that with QoS 2 the segments are first joined in
+    // a temporary buffer, since Paho takes the payload in one piece.
+    int publish(const char* topic, const PublishSegment* segments, size_t count, unsigned int qos, bool retained);
+
+    // Publish with QoS 1 without waiting for the PUBACK, so that several
+    // messages can be on their way at once. A message without PUBACK after
+    // AWS_IOT_MQTT_PUBACK_TIMEOUT is sent again with DUP set, up to
+    // AWS_IOT_MQTT_PUBLISH_RETRIES times. cb (if set) is called with the
+    // result from yield(): 0 when acknowledged, non-zero if not. Messages
+    // still in flight fail on disconnect() and beginConnect(). The packet is
+    // copied, data can be reused right away.
+    // Returns the packet identifier, 0 if the window is full, or
+    // MQTT::FAILURE if not connected or out of memory.
+    int publishAsync(const char* topic, const uint8_t* data, size_t len, bool retained,
+                     publishCallback cb = NULL, void* arg = NULL);
+
+    // Same as above, with the payload made of count segments
+    int publishAsync(const char* topic, const PublishSegment* segments, size_t count, bool retained,
+                     publishCallback cb = NULL, void* arg = NULL);
+
+    // Number of publishAsync() messages that may wait for a PUBACK at the
+    // same time, 1 to AWS_IOT_MQTT_MAX_INFLIGHT. Throughput is about
+    // window / round trip time.
+    void setPublishWindow(size_t window);
+
+    // Number of publishAsync() messages waiting for a PUBACK
+    size_t getPublishesInFlight();
+
+    // Subscribe to topic, which may contain wildcards. A topic can be
+    // subscribed to more than once with different callbacks, all are called.
     // Returns 0 if successful, or non-zero otherwise.
+    // cb gets null terminated copies of topic and payload. The payload is
+    // cut at the first null byte.
     int subscribe(const char* topic, unsigned int qos, subscriptionCallback cb);
 
+    // Subscribe to topic, cb gets the topic and payload without copying
+    int subscribe(const char* topic, unsigned int qos, messageCallback cb);
+
+    // Unsubscribe from topic, removing all its callbacks
     void unsubscribe(const char* topic);
 
   private:
 
-    // Paho MQTT client callbacks are PTFs. Using a global variable to hold object reference
-    // Note that this will break if more than one instance of AWSMqttClient is created
-    static AWSMqttClient* instance;
-
     AWSWebSocketClientAdapter& adapter;
+    // Takes the PUBACKs for publishAsync() and the received messages from
+    // what Paho reads
+    PacketFilter filter;
     IPStack ipstack;
     // TODO Remove config params
     MQTT::Client<IPStack, Countdown, AWS_IOT_MQTT_TX_BUF_LEN, AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS> client;
     MqttParams& params;
 
-    void addCallback(const char* topic, subscriptionCallback cb);
-    void removeCallback(const char* topic);
+    // One of the callbacks is set
+    struct MessageHandler {
+      subscriptionCallback cb;
+      messageCallback mcb;
+
+      bool operator==(const MessageHandler& other) const {
+        return cb == other.cb && mcb == other.mcb;
+      }
+    };
+
+    TopicTrie<MessageHandler> handlers;
+
+    // A publishAsync() message waiting for its PUBACK. Free if id is 0.
+    struct InFlight {
+      unsigned short id;
+      bool acked;
+      int retries;
+      unsigned long sentAt;
+      uint8_t* packet;
+      size_t len;
+      publishCallback cb;
+      void* arg;
+    };
+
+    InFlight inFlight[AWS_IOT_MQTT_MAX_INFLIGHT];
+    size_t inFlightCount;
+    size_t publishWindow;
+    unsigned short lastPacketId;
+
+    ConnectState connectState;
+    connectCallback onConnect;
+    int connectResult;
+
+    void connectDone(int rc);
+
+    // Write a QoS 0 PUBLISH packet to the websocket
+    int publishDirect(const char* topic, const PublishSegment* segments, size_t count, bool retained);
+
+    // publishAsync() and wait for the PUBACK
+    int publishAcked(const char* topic, const PublishSegment* segments, size_t count, bool retained);
+
+    // Write the PUBLISH fixed header and the topic length to header (room
+    // for 7 bytes). Returns the length, or 0 if too long for MQTT.
+    static int publishHeader(uint8_t* header, size_t topicLen, size_t remainingLen, unsigned int qos, bool retained);
+
+    unsigned short nextPacketId();
+    InFlight* findInFlight(unsigned short id);
+
+    // Mark the message acknowledged, if it is one of ours
+    static bool pubackReceived(unsigned short id, void* arg);
+
+    // Dispatch a received PUBLISH and acknowledge it
+    static void publishReceived(uint8_t* packet, size_t len, size_t total, void* arg);
+
+    // Packet identifier of the first len bytes of a QoS 1 PUBLISH. Returns
+    // false if they don't contain it.
+    static bool publishId(const uint8_t* packet, size_t len, unsigned short* id);
+
+    // Report acknowledged messages, resend or fail timed out ones
+    void processPublishes();
+
+    // Complete all messages in flight with rc
+    void failPublishes(int rc);
+    void completePublish(InFlight& f, int rc);
+
+    int subscribe(const char* topic, unsigned int qos, subscriptionCallback cb, messageCallback mcb);
+
+    AWSMqttClient(const AWSMqttClient&);
+    AWSMqttClient& operator=(const AWSMqttClient&);
 
-    subscriptionCallback getCallback(const char* topic);
-    void handleCallback(const char* topic, const char* msg);
+    // Call the callbacks of all filters matching the topic
+    void handleMessage(MQTT::MessageData& md);
+    static void deliver(const MessageHandler& handler, void* arg);
 };
 
 #endif
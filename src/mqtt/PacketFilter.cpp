@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2017 Tomas Nilsson (joekickass)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *    http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "mqtt/PacketFilter.h"
+
+// Packet types, the high nibble of the first byte
+static const uint8_t TYPE_PUBLISH = 3;
+static const uint8_t TYPE_PUBACK = 4;
+
+// PUBACK is the fixed header 0x40 0x02 and the packet identifier
+static const size_t PUBACK_LEN = 4;
+
+// Fixed header: type and flags, and up to 4 bytes of remaining length
+static const size_t FIXED_HEADER_MAX = 5;
+
+PacketFilter::PacketFilter(AWSWebSocketClientAdapter& a, pubackCallback pubackCb,
+                           incomingPublishCallback publishCb, void* arg, size_t maxPacket) :
+  adapter(a),
+  onPuback(pubackCb),
+  onPublish(publishCb),
+  callbackArg(arg),
+  packet(NULL),
+  packetSize(maxPacket)
+{
+  reset();
+}
+
+PacketFilter::~PacketFilter()
+{
+  free(packet);
+}
+
+void PacketFilter::reset()
+{
+  state = STATE_HEADER;
+  remaining = 0;
+  shift = 0;
+  packetTotal = 0;
+  packetRead = 0;
+}
+
+int PacketFilter::takePackets(int available)
+{
+  uint8_t header[FIXED_HEADER_MAX];
+  while (available > 0) {
+    if (state == STATE_TAKEN) {
+      if (!readTaken(available)) {
+        return 0;
+      }
+      available = adapter.available();
+      continue;
+    }
+    if (state != STATE_HEADER) {
+      break;
+    }
+
+    size_t len = adapter.peekBytes(header, sizeof(header));
+    uint8_t type = header[0] >> 4;
+
+    if (type == TYPE_PUBACK) {
+      if (len > 1 && header[1] != PUBACK_LEN - 2) {
+        break;
+      }
+      if (len < PUBACK_LEN) {
+        // The rest has not arrived yet, peekBytes() received what was waiting
+        return 0;
+      }
+      if (!onPuback((header[2] << 8) | header[3], callbackArg)) {
+        break;
+      }
+      adapter.read(header, PUBACK_LEN);
+      available = adapter.available();
+      continue;
+    }
+
+    if (type != TYPE_PUBLISH || onPublish == NULL || ((header[0] >> 1) & 3) > 1) {
+      break;
+    }
+
+    // Remaining length, 7 bits per byte
+    size_t total = 0;
+    size_t i = 1;
+    bool complete = false;
+    for (int bits = 0; i < len && !complete; bits += 7, ++i) {
+      total |= (size_t) (header[i] & 0x7f) << bits;
+      complete = (header[i] & 0x80) == 0;
+    }
+    if (!complete) {
+      if (len < sizeof(header)) {
+        // The rest has not arrived yet
+        return 0;
+      }
+      // Malformed, leave it to the MQTT client
+      break;
+    }
+    state = STATE_TAKEN;
+    packetTotal = i + total;
+    packetRead = 0;
+  }
+  return state == STATE_TAKEN ? 0 : available;
+}
+
+bool PacketFilter::readTaken(int available)
+{
+  if (packetRead == 0 && packet == NULL) {
+    // Dropped below if out of memory
+    packet = (uint8_t*) malloc(packetSize);
+  }
+
+  size_t n = packetTotal - packetRead < (size_t) available ? packetTotal - packetRead : available;
+  size_t keep = packet != NULL && packetRead < packetSize ? packetSize - packetRead : 0;
+  keep = keep < n ? keep : n;
+  if (keep > 0) {
+    adapter.read(packet + packetRead, keep);
+  }
+
+  // Too large for the buffer, skip the rest
+  uint8_t skipped[32];
+  for (size_t done = keep; done < n;) {
+    size_t m = n - done < sizeof(skipped) ? n - done : sizeof(skipped);
+    adapter.read(skipped, m);
+    done += m;
+  }
+
+  packetRead += n;
+  if (packetRead < packetTotal) {
+    return false;
+  }
+
+  // The callback may read a PUBLISH of its own, into a new buffer
+  uint8_t* p = packet;
+  size_t len = packetTotal < packetSize ? packetTotal : packetSize;
+  size_t total = packetTotal;
+  packet = NULL;
+  state = STATE_HEADER;
+  if (p != NULL) {
+    onPublish(p, len, total, callbackArg);
+  }
+  if (packet == NULL) {
+    packet = p;
+  } else {
+    free(p);
+  }
+  return true;
+}
+
+void PacketFilter::count(const uint8_t* buf, size_t len)
+{
+  for (size_t i = 0; i < len; ++i) {
+    switch (state) {
+      case STATE_HEADER:
+        state = STATE_LENGTH;
+        remaining = 0;
+        shift = 0;
+        break;
+      case STATE_LENGTH:
+        remaining |= (size_t) (buf[i] & 0x7f) << shift;
+        shift += 7;
+        if ((buf[i] & 0x80) == 0) {
+          state = remaining > 0 ? STATE_BODY : STATE_HEADER;
+        }
+        break;
+      case STATE_BODY: {
+        size_t n = len - i < remaining ? len - i : remaining;
+        remaining -= n;
+        i += n - 1;
+        if (remaining == 0) {
+          state = STATE_HEADER;
+        }
+        break;
+      }
+      case STATE_TAKEN:
+        // Never passed on
+        break;
+    }
+  }
+}
+
+int PacketFilter::connect(IPAddress ip, uint16_t port)
+{
+  reset();
+  return adapter.connect(ip, port);
+}
+
+int PacketFilter::connect(const char *host, uint16_t port)
+{
+  reset();
+  return adapter.connect(host, port);
+}
+
+size_t PacketFilter::write(uint8_t b)
+{
+  return adapter.write(b);
+}
+
+size_t PacketFilter::write(const uint8_t *buf, size_t size)
+{
+  return adapter.write(buf, size);
+}
+
+int PacketFilter::available()
+{
+  return takePackets(adapter.available());
+}
+
+int PacketFilter::read()
+{
+  if (available() <= 0) {
+    return -1;
+  }
+  uint8_t b;
+  adapter.read(&b, 1);
+  count(&b, 1);
+  return b;
+}
+
+int PacketFilter::read(uint8_t *buf, size_t size)
+{
+  int n = available();
+  if (n <= 0) {
+    return 0;
+  }
+  n = adapter.read(buf, (size_t) n < size ? n : size);
+  count(buf, n);
+  return n;
+}
+
+int PacketFilter::peek()
+{
+  if (available() <= 0) {
+    return -1;
+  }
+  return adapter.peek();
+}
+
+void PacketFilter::flush()
+{
+  adapter.flush();
+}
+
+void PacketFilter::stop()
+{
+  reset();
+  adapter.stop();
+}
+
+uint8_t PacketFilter::connected()
+{
+  return adapter.connected();
+}
+
+PacketFilter::operator bool()
+{
+  return adapter;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2017 Tomas Nilsson (joekickass)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *    http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef PACKETFILTER_H_
+#define PACKETFILTER_H_
+
+#include <Client.h>
+
+#include "aws_iot_config.h"
+#include "ws/WebSocketClientAdapter.h"
+
+// (unsigned short id, void* arg), returns true if the PUBACK was expected
+typedef bool (*pubackCallback) (unsigned short, void*);
+
+// (uint8_t* packet, size_t len, size_t total, void* arg), a PUBLISH packet
+// of total bytes. Only the first len bytes are in packet if it was larger
+// than the filter's packet buffer. packet is only valid during the call.
+typedef void (*incomingPublishCallback) (uint8_t*, size_t, size_t, void*);
+
+/**
+ * Sits between the MQTT client and the websocket adapter, and takes packets
+ * the MQTT client should not handle out of the received stream:
+ *
+ *  - PUBACKs for publishes made outside the MQTT client, before the MQTT
+ *    client reads (and ignores) them. PUBACKs not claimed by the callback
+ *    are passed on.
+ *  - PUBLISHes with QoS 0 and 1, so that they are dispatched by the owner
+ *    of the filter rather than by the MQTT client's context free handler.
+ *    Each is collected in a buffer of maxPacket bytes and handed to the
+ *    callback. QoS 2 is passed on.
+ *
+ * Packets are followed through their fixed header as the MQTT client reads
+ * them. Whenever the next packet starts, the packets at the head of the
+ * receive buffer are looked at. The callbacks are called from available()
+ * and the reads, and may read and write through the filter themselves,
+ * e.g. to publish or subscribe.
+ */
+class PacketFilter : public Client
+{
+public:
+
+  PacketFilter(AWSWebSocketClientAdapter& a, pubackCallback pubackCb, incomingPublishCallback publishCb,
+               void* arg, size_t maxPacket = AWS_IOT_MQTT_RX_BUF_LEN);
+  ~PacketFilter();
+
+  // Forget the packet being read, for a new connection
+  void reset();
+
+  // Arduino Client.h interface
+  virtual int connect(IPAddress ip, uint16_t port);
+  virtual int connect(const char *host, uint16_t port);
+  virtual size_t write(uint8_t b);
+  virtual size_t write(const uint8_t *buf, size_t size);
+  virtual int available();
+  virtual int read();
+  virtual int read(uint8_t *buf, size_t size);
+  virtual int peek();
+  virtual void flush();
+  virtual void stop();
+  virtual uint8_t connected();
+  virtual operator bool();
+
+private:
+
+  // Position in the packet being read
+  enum State {
+    STATE_HEADER,
+    STATE_LENGTH,
+    STATE_BODY,
+    // A PUBLISH being taken out of the stream
+    STATE_TAKEN
+  };
+
+  AWSWebSocketClientAdapter& adapter;
+  pubackCallback onPuback;
+  incomingPublishCallback onPublish;
+  void* callbackArg;
+
+  State state;
+  size_t remaining;
+  int shift;
+
+  // Buffer for the PUBLISH being taken, allocated on first use. Handed to
+  // the callback, and null during the call, so a PUBLISH taken by a nested
+  // read gets a buffer of its own.
+  uint8_t* packet;
+  size_t packetSize;
+  size_t packetTotal;
+  size_t packetRead;
+
+  PacketFilter(const PacketFilter&);
+  PacketFilter& operator=(const PacketFilter&);
+
+  // Take claimed PUBACKs and PUBLISHes from the head of the buffer, if a
+  // packet starts there. Returns the bytes left to read, 0 while a packet
+  // to take is incomplete.
+  int takePackets(int available);
+
+  // Read up to available bytes of the PUBLISH being taken. Returns true
+  // when it is complete and was handed to the callback.
+  bool readTaken(int available);
+
+  // Follow len bytes read by the MQTT client
+  void count(const uint8_t* buf, size_t len);
+};
+
+#endif
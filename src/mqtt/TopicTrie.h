@@ -0,0 +1,659 @@
+/*
+ * Copyright (C) 2017 Tomas Nilsson (joekickass)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *    http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef TOPICTRIE_H_
+#define TOPICTRIE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Matches MQTT topics against topic filters with + and # wildcards, and
+ * keeps any number of handlers per filter.
+ *
+ * Every filter level is a node. Named children are found through a single
+ * hash table keyed by parent node and level name, and + and # are direct
+ * links from their parent, so matching a topic is O(topic levels) no matter
+ * how many filters there are (plus a branch for each matching wildcard).
+ *
+ * T is the handler type. It is moved with realloc, so it must be plain data,
+ * and compared with ==.
+ *
+ * As in MQTT 3.1.1, a # also matches its parent level ("a/#" matches "a"),
+ * and topics starting with $ are not matched by a wildcard on the first
+ * level.
+ */
+template<class T>
+class TopicTrie
+{
+public:
+
+  // Called for each handler of each filter that matches a topic
+  typedef void (*Visitor)(const T& handler, void* arg);
+
+  TopicTrie();
+  ~TopicTrie();
+
+  // Add handler to filter, unless it is there already. Returns false if
+  // the filter is not valid or memory ran out. If added is given, it is
+  // set to true only if the handler was not there before, e.g. to know
+  // whether to remove it again if a later step fails.
+  bool add(const char* filter, const T& handler, bool* added = NULL);
+
+  // Remove handler from filter. Returns false if it was not there.
+  bool remove(const char* filter, const T& handler);
+
+  // Remove all handlers of filter. Returns the number removed.
+  size_t removeAll(const char* filter);
+
+  // Remove everything and free all memory
+  void clear();
+
+  // Call visit for the handlers of all filters matching the topic (len
+  // bytes, not null terminated). Returns the number of calls. The handlers
+  // are collected before the first call, so visit may add and remove
+  // handlers (or clear()): all handlers matching when match() was called
+  // are called, ones added meanwhile are not.
+  size_t match(const char* topic, size_t len, Visitor visit, void* arg) const;
+
+  // Number of handlers
+  size_t getSize() const;
+
+  // Non-empty, and + and # only as whole levels, # only last
+  static bool isValidFilter(const char* filter);
+
+private:
+
+  static const size_t NONE = (size_t) -1;
+
+  enum NodeType {
+    NODE_FREE,
+    NODE_LEVEL,
+    NODE_PLUS,
+    NODE_HASH
+  };
+
+  struct Node {
+    NodeType type;
+    // Next free node, if free. NONE for the root.
+    size_t parent;
+    size_t plus;
+    size_t hash;
+    // Number of child nodes, including plus and hash
+    size_t children;
+    // First handler entry
+    size_t handlers;
+    // Level name, only for NODE_LEVEL (but not the root)
+    char* key;
+    size_t keyLen;
+    uint32_t keyHash;
+  };
+
+  struct Entry {
+    T handler;
+    // Next handler of the same node, or next free entry
+    size_t next;
+  };
+
+  // Node 0 is the root, once anything has been added
+  Node* nodes;
+  size_t nodeCapacity;
+  size_t nodeCount;
+  size_t freeNodes;
+
+  Entry* entries;
+  size_t entryCapacity;
+  size_t entryCount;
+  size_t freeEntries;
+  size_t handlerCount;
+
+  // Open addressing, linear probing. Node numbers of NODE_LEVEL nodes,
+  // NONE if empty. Kept at most half full.
+  size_t* table;
+  size_t tableCapacity;
+  size_t tableCount;
+
+  // Handlers collected on the stack by match(), more need an allocation
+  static const size_t MATCH_BUFFER = 8;
+
+  TopicTrie(const TopicTrie&);
+  TopicTrie& operator=(const TopicTrie&);
+
+  template<class U>
+  static bool reserve(U*& array, size_t& capacity, size_t needed);
+
+  static uint32_t hashLevel(size_t parent, const char* level, size_t len);
+
+  size_t findChild(size_t parent, const char* level, size_t len) const;
+  size_t getChild(size_t parent, const char* level, size_t len) const;
+  size_t addChild(size_t parent, const char* level, size_t len);
+  void deleteNode(size_t n);
+
+  // Delete n and its parents while they have no handlers and no children
+  void prune(size_t n);
+
+  // Node of filter, or NONE. Creates missing nodes if create is set.
+  size_t findFilter(const char* filter, bool create);
+
+  bool growTable();
+  void insertSlot(size_t n);
+  void eraseSlot(size_t n);
+
+  void freeEntry(size_t e);
+
+  // Append the handlers matching level (and what follows) below n to out,
+  // which has room for size, starting at count. Returns the new count,
+  // which keeps counting past size.
+  size_t matchNode(size_t n, const char* level, const char* end, bool wildcards,
+                   T* out, size_t size, size_t count) const;
+  size_t collectHandlers(size_t e, T* out, size_t size, size_t count) const;
+};
+
+template<class T>
+TopicTrie<T>::TopicTrie() :
+  nodes(NULL), nodeCapacity(0), nodeCount(0), freeNodes(NONE),
+  entries(NULL), entryCapacity(0), entryCount(0), freeEntries(NONE), handlerCount(0),
+  table(NULL), tableCapacity(0), tableCount(0)
+{
+}
+
+template<class T>
+TopicTrie<T>::~TopicTrie()
+{
+  clear();
+}
+
+template<class T>
+bool TopicTrie<T>::add(const char* filter, const T& handler, bool* added)
+{
+  if (added != NULL) {
+    *added = false;
+  }
+  if (!isValidFilter(filter)) {
+    return false;
+  }
+
+  if (nodeCount == 0) {
+    if (!reserve(nodes, nodeCapacity, 1)) {
+      return false;
+    }
+    Node& root = nodes[nodeCount++];
+    root.type = NODE_LEVEL;
+    root.parent = NONE;
+    root.plus = NONE;
+    root.hash = NONE;
+    root.children = 0;
+    root.handlers = NONE;
+    root.key = NULL;
+    root.keyLen = 0;
+    root.keyHash = 0;
+  }
+
+  size_t n = findFilter(filter, true);
+  if (n == NONE) {
+    return false;
+  }
+
+  size_t last = NONE;
+  for (size_t e = nodes[n].handlers; e != NONE; e = entries[e].next) {
+    if (entries[e].handler == handler) {
+      return true;
+    }
+    last = e;
+  }
+
+  size_t e = freeEntries;
+  if (e != NONE) {
+    freeEntries = entries[e].next;
+  } else if (reserve(entries, entryCapacity, entryCount + 1)) {
+    e = entryCount++;
+  } else {
+    prune(n);
+    return false;
+  }
+  entries[e].handler = handler;
+  entries[e].next = NONE;
+
+  // Keep the order handlers were added in
+  if (last == NONE) {
+    nodes[n].handlers = e;
+  } else {
+    entries[last].next = e;
+  }
+  ++handlerCount;
+  if (added != NULL) {
+    *added = true;
+  }
+  return true;
+}
+
+template<class T>
+bool TopicTrie<T>::remove(const char* filter, const T& handler)
+{
+  size_t n = nodeCount > 0 ? findFilter(filter, false) : NONE;
+  if (n == NONE) {
+    return false;
+  }
+
+  size_t prev = NONE;
+  for (size_t e = nodes[n].handlers; e != NONE; prev = e, e = entries[e].next) {
+    if (entries[e].handler == handler) {
+      if (prev == NONE) {
+        nodes[n].handlers = entries[e].next;
+      } else {
+        entries[prev].next = entries[e].next;
+      }
+      freeEntry(e);
+      prune(n);
+      return true;
+    }
+  }
+  return false;
+}
+
+template<class T>
+size_t TopicTrie<T>::removeAll(const char* filter)
+{
+  size_t n = nodeCount > 0 ? findFilter(filter, false) : NONE;
+  if (n == NONE) {
+    return 0;
+  }
+
+  size_t removed = 0;
+  size_t e = nodes[n].handlers;
+  while (e != NONE) {
+    size_t next = entries[e].next;
+    freeEntry(e);
+    e = next;
+    ++removed;
+  }
+  nodes[n].handlers = NONE;
+  prune(n);
+  return removed;
+}
+
+template<class T>
+void TopicTrie<T>::clear()
+{
+  for (size_t n = 1; n < nodeCount; ++n) {
+    if (nodes[n].type == NODE_LEVEL) {
+      free(nodes[n].key);
+    }
+  }
+  free(nodes);
+  free(entries);
+  free(table);
+
+  nodes = NULL;
+  nodeCapacity = 0;
+  nodeCount = 0;
+  freeNodes = NONE;
+  entries = NULL;
+  entryCapacity = 0;
+  entryCount = 0;
+  freeEntries = NONE;
+  handlerCount = 0;
+  table = NULL;
+  tableCapacity = 0;
+  tableCount = 0;
+}
+
+template<class T>
+size_t TopicTrie<T>::match(const char* topic, size_t len, Visitor visit, void* arg) const
+{
+  if (nodeCount == 0) {
+    return 0;
+  }
+  // No wildcards on the first level of $SYS, $aws, ...
+  bool wildcards = len == 0 || topic[0] != '$';
+  const char* end = topic + len;
+
+  // Collect first, visitors may modify the trie
+  T local[MATCH_BUFFER];
+  T* matched = local;
+  size_t count = matchNode(0, topic, end, wildcards, local, MATCH_BUFFER, 0);
+  if (count > MATCH_BUFFER) {
+    matched = new T[count];
+    matchNode(0, topic, end, wildcards, matched, count, 0);
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    visit(matched[i], arg);
+  }
+  if (matched != local) {
+    delete[] matched;
+  }
+  return count;
+}
+
+template<class T>
+size_t TopicTrie<T>::getSize() const
+{
+  return handlerCount;
+}
+
+template<class T>
+bool TopicTrie<T>::isValidFilter(const char* filter)
+{
+  if (filter == NULL || *filter == '\0') {
+    return false;
+  }
+
+  const char* level = filter;
+  for (const char* p = filter; ; ++p) {
+    if (*p == '/' || *p == '\0') {
+      level = p + 1;
+    } else if (*p == '+' || *p == '#') {
+      // Whole level, and # only as the last one
+      if (p != level || (p[1] != '/' && p[1] != '\0') || (*p == '#' && p[1] != '\0')) {
+        return false;
+      }
+    }
+    if (*p == '\0') {
+      return true;
+    }
+  }
+}
+
+template<class T>
+template<class U>
+bool TopicTrie<T>::reserve(U*& array, size_t& capacity, size_t needed)
+{
+  if (needed <= capacity) {
+    return true;
+  }
+  size_t newCapacity = capacity > 0 ? capacity : 8;
+  while (newCapacity < needed) {
+    newCapacity *= 2;
+  }
+  U* newArray = (U*) realloc(array, newCapacity * sizeof(U));
+  if (newArray == NULL) {
+    return false;
+  }
+  array = newArray;
+  capacity = newCapacity;
+  return true;
+}
+
+template<class T>
+uint32_t TopicTrie<T>::hashLevel(size_t parent, const char* level, size_t len)
+{
+  // FNV-1a, then mix in the parent
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; ++i) {
+    h = (h ^ (uint8_t) level[i]) * 16777619u;
+  }
+  return h ^ ((uint32_t) parent * 2654435761u);
+}
+
+template<class T>
+size_t TopicTrie<T>::findChild(size_t parent, const char* level, size_t len) const
+{
+  if (tableCount == 0) {
+    return NONE;
+  }
+  uint32_t h = hashLevel(parent, level, len);
+  size_t mask = tableCapacity - 1;
+  for (size_t i = h & mask; table[i] != NONE; i = (i + 1) & mask) {
+    const Node& node = nodes[table[i]];
+    if (node.keyHash == h && node.parent == parent && node.keyLen == len &&
+        memcmp(node.key, level, len) == 0) {
+      return table[i];
+    }
+  }
+  return NONE;
+}
+
+template<class T>
+size_t TopicTrie<T>::getChild(size_t parent, const char* level, size_t len) const
+{
+  if (len == 1 && level[0] == '+') {
+    return nodes[parent].plus;
+  }
+  if (len == 1 && level[0] == '#') {
+    return nodes[parent].hash;
+  }
+  return findChild(parent, level, len);
+}
+
+template<class T>
+size_t TopicTrie<T>::addChild(size_t parent, const char* level, size_t len)
+{
+  NodeType type = NODE_LEVEL;
+  if (len == 1 && level[0] == '+') {
+    type = NODE_PLUS;
+  } else if (len == 1 && level[0] == '#') {
+    type = NODE_HASH;
+  }
+
+  char* key = NULL;
+  if (type == NODE_LEVEL) {
+    // Before the node exists, growing rehashes all nodes
+    if (!growTable() || (key = (char*) malloc(len + 1)) == NULL) {
+      return NONE;
+    }
+    memcpy(key, level, len);
+    key[len] = '\0';
+  }
+
+  size_t n = freeNodes;
+  if (n != NONE) {
+    freeNodes = nodes[n].parent;
+  } else if (reserve(nodes, nodeCapacity, nodeCount + 1)) {
+    n = nodeCount++;
+  } else {
+    free(key);
+    return NONE;
+  }
+
+  Node& node = nodes[n];
+  node.type = type;
+  node.parent = parent;
+  node.plus = NONE;
+  node.hash = NONE;
+  node.children = 0;
+  node.handlers = NONE;
+  node.key = key;
+  node.keyLen = len;
+  node.keyHash = type == NODE_LEVEL ? hashLevel(parent, level, len) : 0;
+
+  if (type == NODE_PLUS) {
+    nodes[parent].plus = n;
+  } else if (type == NODE_HASH) {
+    nodes[parent].hash = n;
+  } else {
+    insertSlot(n);
+  }
+  ++nodes[parent].children;
+  return n;
+}
+
+template<class T>
+void TopicTrie<T>::deleteNode(size_t n)
+{
+  Node& node = nodes[n];
+  if (node.type == NODE_PLUS) {
+    nodes[node.parent].plus = NONE;
+  } else if (node.type == NODE_HASH) {
+    nodes[node.parent].hash = NONE;
+  } else {
+    eraseSlot(n);
+    free(node.key);
+    node.key = NULL;
+  }
+  --nodes[node.parent].children;
+
+  node.type = NODE_FREE;
+  node.parent = freeNodes;
+  freeNodes = n;
+}
+
+template<class T>
+void TopicTrie<T>::prune(size_t n)
+{
+  while (n != 0 && nodes[n].handlers == NONE && nodes[n].children == 0) {
+    size_t parent = nodes[n].parent;
+    deleteNode(n);
+    n = parent;
+  }
+}
+
+template<class T>
+size_t TopicTrie<T>::findFilter(const char* filter, bool create)
+{
+  size_t n = 0;
+  const char* level = filter;
+  for (;;) {
+    const char* sep = strchr(level, '/');
+    size_t len = sep != NULL ? (size_t) (sep - level) : strlen(level);
+
+    size_t child = getChild(n, level, len);
+    if (child == NONE) {
+      if (!create) {
+        return NONE;
+      }
+      child = addChild(n, level, len);
+      if (child == NONE) {
+        // Don't leave the levels added so far behind
+        prune(n);
+        return NONE;
+      }
+    }
+
+    n = child;
+    if (sep == NULL) {
+      return n;
+    }
+    level = sep + 1;
+  }
+}
+
+template<class T>
+bool TopicTrie<T>::growTable()
+{
+  if ((tableCount + 1) * 2 <= tableCapacity) {
+    return true;
+  }
+
+  size_t newCapacity = tableCapacity > 0 ? tableCapacity * 2 : 16;
+  size_t* newTable = (size_t*) malloc(newCapacity * sizeof(size_t));
+  if (newTable == NULL) {
+    return false;
+  }
+  free(table);
+  table = newTable;
+  tableCapacity = newCapacity;
+  tableCount = 0;
+  for (size_t i = 0; i < tableCapacity; ++i) {
+    table[i] = NONE;
+  }
+  for (size_t n = 1; n < nodeCount; ++n) {
+    if (nodes[n].type == NODE_LEVEL) {
+      insertSlot(n);
+    }
+  }
+  return true;
+}
+
+template<class T>
+void TopicTrie<T>::insertSlot(size_t n)
+{
+  size_t mask = tableCapacity - 1;
+  size_t i = nodes[n].keyHash & mask;
+  while (table[i] != NONE) {
+    i = (i + 1) & mask;
+  }
+  table[i] = n;
+  ++tableCount;
+}
+
+template<class T>
+void TopicTrie<T>::eraseSlot(size_t n)
+{
+  size_t mask = tableCapacity - 1;
+  size_t i = nodes[n].keyHash & mask;
+  while (table[i] != n) {
+    i = (i + 1) & mask;
+  }
+
+  // Move back later nodes of the same probe sequence into the gap, so no
+  // tombstones are needed
+  for (size_t j = (i + 1) & mask; table[j] != NONE; j = (j + 1) & mask) {
+    size_t home = nodes[table[j]].keyHash & mask;
+    bool reachable = i < j ? (i < home && home <= j) : (i < home || home <= j);
+    if (!reachable) {
+      table[i] = table[j];
+      i = j;
+    }
+  }
+  table[i] = NONE;
+  --tableCount;
+}
+
+template<class T>
+void TopicTrie<T>::freeEntry(size_t e)
+{
+  entries[e].next = freeEntries;
+  freeEntries = e;
+  --handlerCount;
+}
+
+template<class T>
+size_t TopicTrie<T>::matchNode(size_t n, const char* level, const char* end, bool wildcards,
+                               T* out, size_t size, size_t count) const
+{
+  const Node& node = nodes[n];
+
+  // # matches this level and everything below
+  if (wildcards && node.hash != NONE) {
+    count = collectHandlers(nodes[node.hash].handlers, out, size, count);
+  }
+
+  // Past the last level
+  if (level == NULL) {
+    return collectHandlers(node.handlers, out, size, count);
+  }
+
+  const char* sep = (const char*) memchr(level, '/', end - level);
+  size_t len = (sep != NULL ? sep : end) - level;
+  const char* next = sep != NULL ? sep + 1 : NULL;
+
+  size_t child = findChild(n, level, len);
+  if (child != NONE) {
+    count = matchNode(child, next, end, true, out, size, count);
+  }
+  if (wildcards && node.plus != NONE) {
+    count = matchNode(node.plus, next, end, true, out, size, count);
+  }
+  return count;
+}
+
+template<class T>
+size_t TopicTrie<T>::collectHandlers(size_t e, T* out, size_t size, size_t count) const
+{
+  for (; e != NONE; e = entries[e].next) {
+    if (count < size) {
+      out[count] = entries[e].handler;
+    }
+    ++count;
+  }
+  return count;
+}
+
+#endif
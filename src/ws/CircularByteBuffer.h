@@ -25,13 +25,32 @@ along with aws-mqtt-websockets.  If not, see <http://www.gnu.org/licenses/>
 #define NODEBUG_CBB
 #endif
 
+/*
+ * Byte FIFO on a ring of power of two size. begin and end run freely and
+ * are masked on access, so the whole capacity is usable and size is
+ * end - begin, also after the indices wrap around.
+ *
+ * Besides the byte and block push/pop, the readable and writable regions
+ * can be accessed in place as at most two contiguous spans each.
+ *
+ * The largest size reached is tracked as high-water mark, to help tune the
+ * capacity.
+ */
 class CircularByteBuffer {
 public:
 
+	struct Span {
+		byte* data;
+		size_t len;
+	};
+
 	CircularByteBuffer () {
 		data = NULL;
-		size = 0;
 		capacity = 0;
+		mask = 0;
+		begin = 0;
+		end = 0;
+		highWaterMark = 0;
 	}
 	~CircularByteBuffer(){
 		if (data!=NULL)
@@ -40,7 +59,6 @@ public:
 
 	void clear ()
 	{
-		size = 0;
 		begin = 0;
 		end = 0;
 	}
@@ -50,91 +68,188 @@ public:
 			free (data);
 			data = NULL;
 		}
+		capacity = 0;
+		mask = 0;
+		clear();
 	}
 
-	void init (long capacity) {
+	// Capacity is rounded up to a power of two
+	void init (size_t minCapacity) {
 		if (data!=NULL)
 			free (data);
+		capacity = 1;
+		while (capacity < minCapacity)
+			capacity <<= 1;
 		data = (byte*) malloc (capacity);
-		size = 0;
+		mask = capacity - 1;
 		begin = 0;
 		end = 0;
-		this->capacity = capacity;
+		highWaterMark = 0;
+	}
+
+	// Grow to at least minCapacity (rounded up to a power of two), keeping
+	// the content. Returns false if out of memory, the buffer is unchanged
+	// then.
+	bool grow (size_t minCapacity) {
+		size_t newCapacity = capacity > 0 ? capacity : 1;
+		while (newCapacity < minCapacity)
+			newCapacity <<= 1;
+		if (newCapacity == capacity)
+			return true;
+		byte* newData = (byte*) malloc (newCapacity);
+		if (newData == NULL) {
+			DEBUG_CBB ("out of memory");
+			return false;
+		}
+		size_t size = getSize();
+		pop (newData, size);
+		if (data!=NULL)
+			free (data);
+		data = newData;
+		capacity = newCapacity;
+		mask = capacity - 1;
+		begin = 0;
+		end = size;
+		return true;
+	}
+
+	size_t getSize () {
+		return end - begin;
+	}
+
+	size_t getCapacity () {
+		return capacity;
 	}
 
-	long getSize () {
-		return size;
+	size_t getFree () {
+		return capacity - getSize();
+	}
+
+	// Largest size since init() or resetHighWaterMark()
+	size_t getHighWaterMark () {
+		return highWaterMark;
+	}
+
+	void resetHighWaterMark () {
+		highWaterMark = getSize();
 	}
 
 	byte peek () {
-		return data[begin];
+		if (begin == end) {
+			DEBUG_CBB ("buffer empty");
+			return 0;
+		}
+		return data[begin & mask];
 	}
+
 	void push (byte b) {
-		if (size+1 == capacity) {
+		if (getSize() == capacity) {
 			DEBUG_CBB ("buffer full");
 			return;
 		}
-		data[end] = b;
-		end = (end+1) % capacity;
-		size += 1;
-
+		data[end & mask] = b;
+		end++;
+		updateHighWaterMark();
 	}
 
 	byte pop () {
-		if (size == 0){
+		if (begin == end){
 			DEBUG_CBB ("buffer empty");
 			return 0;
 		}
-		byte ret = data[begin];
-		begin = (begin+1) % capacity;
-		size -= 1;
-		return ret;
-
+		return data[begin++ & mask];
 	}
 
-	void push (byte* b, long len){
-		if (size+len >= capacity) {
+	// Push all of b, or nothing if it doesn't fit. Returns true if pushed.
+	bool push (const byte* b, size_t len){
+		if (len > getFree()) {
 			DEBUG_CBB ("buffer full");
-			return;
+			return false;
 		}
-		if ( (end + len)  <= capacity ) {
-			memcpy ((void*)&data[end],b,len);
-			end += len;
+		size_t offset = end & mask;
+		if (offset + len <= capacity) {
+			memcpy (&data[offset], b, len);
 		} else {
-			long endSide = capacity - end;
-			memcpy ((void*)&data[end],b,endSide);
-			end = 0;
-			memcpy ((void*)&data[end],b+endSide,len-endSide);
-			end += len-endSide;
+			size_t endSide = capacity - offset;
+			memcpy (&data[offset], b, endSide);
+			memcpy (data, b + endSide, len - endSide);
 		}
-		size += len;
-
+		end += len;
+		updateHighWaterMark();
+		return true;
 	}
 
-	byte* pop (byte* b, long len){
-		if ( (size - len) < 0 ) {
+	// Pop len bytes into b. Returns b, or NULL (popping nothing) if there
+	// are less than len bytes.
+	byte* pop (byte* b, size_t len){
+		if (len > getSize()) {
 			DEBUG_CBB ("buffer empty");
 			return NULL;
 		}
-		if ( (begin + len)  <= capacity ) {
-			memcpy (b,(void*)&data[begin],len);
-			begin += len;
+		size_t offset = begin & mask;
+		if (offset + len <= capacity) {
+			memcpy (b, &data[offset], len);
 		} else {
-			long endSide = capacity - begin;
-			memcpy (b,(void*)&data[begin],endSide);
-			begin = 0;
-			memcpy (b+endSide,(void*)&data[begin],len-endSide);
-			begin += len-endSide;
+			size_t endSide = capacity - offset;
+			memcpy (b, &data[offset], endSide);
+			memcpy (b + endSide, data, len - endSide);
 		}
-		size -= len;
+		begin += len;
+		return b;
+	}
+
+	// Readable bytes, oldest first. Returns the number of non-empty spans,
+	// unused spans have length 0. Call consume() when done with them.
+	int getReadSpans (Span spans[2]) {
+		return getSpans(begin, getSize(), spans);
+	}
+
+	// Drop len readable bytes, len must not exceed getSize()
+	void consume (size_t len) {
+		begin += len;
+	}
+
+	// Free space, in the order it is filled. Returns the number of non-empty
+	// spans. Call commit() with the number of bytes written.
+	int getWriteSpans (Span spans[2]) {
+		return getSpans(end, getFree(), spans);
+	}
+
+	// Make len written bytes readable, len must not exceed getFree()
+	void commit (size_t len) {
+		end += len;
+		updateHighWaterMark();
 	}
 
 private:
 	byte* data;
-	long capacity;
-	long size;
-	long begin;
-	long end;
+	size_t capacity;
+	size_t mask;
+	size_t begin;
+	size_t end;
+	size_t highWaterMark;
+
+	void updateHighWaterMark () {
+		if (getSize() > highWaterMark)
+			highWaterMark = getSize();
+	}
+
+	int getSpans (size_t from, size_t len, Span spans[2]) {
+		size_t offset = from & mask;
+		size_t first = capacity - offset;
+		if (len <= first) {
+			spans[0].data = data + offset;
+			spans[0].len = len;
+			spans[1].data = data;
+			spans[1].len = 0;
+			return len > 0 ? 1 : 0;
+		}
+		spans[0].data = data + offset;
+		spans[0].len = first;
+		spans[1].data = data;
+		spans[1].len = len - first;
+		return 2;
+	}
 };
 
 
@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2017 Tomas Nilsson (joekickass)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *    http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SPSCBYTEBUFFER_H_
+#define SPSCBYTEBUFFER_H_
+
+#include <Arduino.h>
+#include <atomic>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * SpscByteBuffer
+ *
+ * Lock-free byte FIFO for one producer and one consumer thread, e.g. a
+ * websocket event task and the MQTT client on a multi-core target. Same
+ * interface as CircularByteBuffer, but every function is either producer
+ * side (push, getWriteSpans, commit, getFree) or consumer side (pop, peek,
+ * getReadSpans, consume, getSize) and may only be called from that thread.
+ * init(), clear() and grow() need both sides to be idle.
+ *
+ * begin is written by the consumer only and end by the producer only. Each
+ * side publishes its index with release and reads the other with acquire,
+ * so data written before an index update is visible to the other side once
+ * it sees the update. The indices are kept on separate cache lines, next to
+ * a cached copy of the other side's index, so the two threads don't fight
+ * over a cache line on every call.
+ */
+class SpscByteBuffer
+{
+  public:
+
+    struct Span {
+      byte* data;
+      size_t len;
+    };
+
+    SpscByteBuffer() :
+      data(NULL),
+      capacity(0),
+      mask(0)
+    {
+      begin.store(0, std::memory_order_relaxed);
+      end.store(0, std::memory_order_relaxed);
+      highWaterMark.store(0, std::memory_order_relaxed);
+      cachedBegin = 0;
+      cachedEnd = 0;
+    }
+
+    ~SpscByteBuffer()
+    {
+      if (data != NULL) {
+        free(data);
+      }
+    }
+
+    // Capacity is rounded up to a power of two
+    void init(size_t minCapacity)
+    {
+      if (data != NULL) {
+        free(data);
+      }
+      capacity = 1;
+      while (capacity < minCapacity) {
+        capacity <<= 1;
+      }
+      data = (byte*) malloc(capacity);
+      mask = capacity - 1;
+      highWaterMark.store(0, std::memory_order_relaxed);
+      clear();
+    }
+
+    void clear()
+    {
+      begin.store(0, std::memory_order_relaxed);
+      end.store(0, std::memory_order_relaxed);
+      cachedBegin = 0;
+      cachedEnd = 0;
+    }
+
+    // Growing would need the consumer to stop, so it is not supported
+    bool grow(size_t minCapacity)
+    {
+      return minCapacity <= capacity;
+    }
+
+    size_t getCapacity()
+    {
+      return capacity;
+    }
+
+    /* Consumer side */
+
+    size_t getSize()
+    {
+      cachedEnd = end.load(std::memory_order_acquire);
+      return cachedEnd - begin.load(std::memory_order_relaxed);
+    }
+
+    byte peek()
+    {
+      size_t b = begin.load(std::memory_order_relaxed);
+      if (!readable(b, 1)) {
+        return 0;
+      }
+      return data[b & mask];
+    }
+
+    byte pop()
+    {
+      size_t b = begin.load(std::memory_order_relaxed);
+      if (!readable(b, 1)) {
+        return 0;
+      }
+      byte ret = data[b & mask];
+      begin.store(b + 1, std::memory_order_release);
+      return ret;
+    }
+
+    // Pop len bytes into b. Returns b, or NULL (popping nothing) if there
+    // are less than len bytes.
+    byte* pop(byte* b, size_t len)
+    {
+      size_t from = begin.load(std::memory_order_relaxed);
+      if (!readable(from, len)) {
+        return NULL;
+      }
+      size_t offset = from & mask;
+      if (offset + len <= capacity) {
+        memcpy(b, &data[offset], len);
+      } else {
+        size_t endSide = capacity - offset;
+        memcpy(b, &data[offset], endSide);
+        memcpy(b + endSide, data, len - endSide);
+      }
+      begin.store(from + len, std::memory_order_release);
+      return b;
+    }
+
+    // Readable bytes, oldest first. Returns the number of non-empty spans.
+    int getReadSpans(Span spans[2])
+    {
+      size_t from = begin.load(std::memory_order_relaxed);
+      cachedEnd = end.load(std::memory_order_acquire);
+      return getSpans(from, cachedEnd - from, spans);
+    }
+
+    // Drop len readable bytes, len must not exceed the last getSize() or
+    // getReadSpans()
+    void consume(size_t len)
+    {
+      begin.store(begin.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+    /* Producer side */
+
+    size_t getFree()
+    {
+      cachedBegin = begin.load(std::memory_order_acquire);
+      return capacity - (end.load(std::memory_order_relaxed) - cachedBegin);
+    }
+
+    // Largest size since init() or resetHighWaterMark(), as seen by the
+    // producer. May be a little high, the consumer's progress is only
+    // checked when space runs out. Unlike the rest of the producer side,
+    // these two may be called from either thread, e.g. for statistics. A
+    // reset racing with a push may be lost.
+    size_t getHighWaterMark()
+    {
+      return highWaterMark.load(std::memory_order_relaxed);
+    }
+
+    void resetHighWaterMark()
+    {
+      highWaterMark.store(0, std::memory_order_relaxed);
+    }
+
+    void push(byte b)
+    {
+      size_t to = end.load(std::memory_order_relaxed);
+      if (!writable(to, 1)) {
+        return;
+      }
+      data[to & mask] = b;
+      end.store(to + 1, std::memory_order_release);
+      updateHighWaterMark(to + 1);
+    }
+
+    // Push all of b, or nothing if it doesn't fit. Returns true if pushed.
+    bool push(const byte* b, size_t len)
+    {
+      size_t to = end.load(std::memory_order_relaxed);
+      if (!writable(to, len)) {
+        return false;
+      }
+      size_t offset = to & mask;
+      if (offset + len <= capacity) {
+        memcpy(&data[offset], b, len);
+      } else {
+        size_t endSide = capacity - offset;
+        memcpy(&data[offset], b, endSide);
+        memcpy(data, b + endSide, len - endSide);
+      }
+      end.store(to + len, std::memory_order_release);
+      updateHighWaterMark(to + len);
+      return true;
+    }
+
+    // Free space, in the order it is filled. Returns the number of non-empty
+    // spans.
+    int getWriteSpans(Span spans[2])
+    {
+      size_t to = end.load(std::memory_order_relaxed);
+      cachedBegin = begin.load(std::memory_order_acquire);
+      return getSpans(to, capacity - (to - cachedBegin), spans);
+    }
+
+    // Make len written bytes readable, len must not exceed the last
+    // getFree() or getWriteSpans()
+    void commit(size_t len)
+    {
+      size_t to = end.load(std::memory_order_relaxed) + len;
+      end.store(to, std::memory_order_release);
+      updateHighWaterMark(to);
+    }
+
+  private:
+
+    static const size_t CACHE_LINE = 64;
+
+    // Shared, read-only after init()
+    byte* data;
+    size_t capacity;
+    size_t mask;
+
+    // Consumer's line: its index and its copy of the producer's
+    alignas(CACHE_LINE) std::atomic<size_t> begin;
+    size_t cachedEnd;
+
+    // Producer's line
+    alignas(CACHE_LINE) std::atomic<size_t> end;
+    size_t cachedBegin;
+    std::atomic<size_t> highWaterMark;
+
+    // Check the cached index first, only load the shared one if needed
+    bool readable(size_t from, size_t len)
+    {
+      if (cachedEnd - from >= len) {
+        return true;
+      }
+      cachedEnd = end.load(std::memory_order_acquire);
+      return cachedEnd - from >= len;
+    }
+
+    bool writable(size_t to, size_t len)
+    {
+      if (capacity - (to - cachedBegin) >= len) {
+        return true;
+      }
+      cachedBegin = begin.load(std::memory_order_acquire);
+      return capacity - (to - cachedBegin) >= len;
+    }
+
+    void updateHighWaterMark(size_t to)
+    {
+      size_t size = to - cachedBegin;
+      if (size > highWaterMark.load(std::memory_order_relaxed)) {
+        highWaterMark.store(size, std::memory_order_relaxed);
+      }
+    }
+
+    int getSpans(size_t from, size_t len, Span spans[2])
+    {
+      size_t offset = from & mask;
+      size_t first = capacity - offset;
+      spans[0].data = data + offset;
+      spans[1].data = data;
+      if (len <= first) {
+        spans[0].len = len;
+        spans[1].len = 0;
+        return len > 0 ? 1 : 0;
+      }
+      spans[0].len = first;
+      spans[1].len = len - first;
+      return 2;
+    }
+};
+
+#endif
@@ -16,13 +16,37 @@
 
 #include "ws/WebSocketClientAdapter.h"
 
+// Number of immediate reconnects after a rejected handshake
+static const int HANDSHAKE_RETRIES = 1;
+
 WebSocketParams::~WebSocketParams() {}
 
 AWSWebSocketClientAdapter::AWSWebSocketClientAdapter(WebSocketParams& p, size_t bufferSize) :
   ws(),
+  overflowPolicy(OVERFLOW_DROP),
+  overflowLimit(0),
+  droppedFrames(0),
+  droppedBytes(0),
+  receivedBytes(0),
+  frameMode(false),
+  frameHead(0),
+  frameCount(0),
+  frameOffset(0),
+  writeBuffer(NULL),
+  writeBufferSize(0),
+  writeLen(0),
   params(p),
-  isConnected(false)
+  isConnected(false),
+  isConnecting(false),
+  connectStatus(CONNECT_IDLE),
+  connectTimeout(5000),
+  handshakeStartedAt(0),
+  handshakeRetries(0),
+  wasRejected(false)
 {
+  rejectReason[0] = '\0';
+  resetWriteStats();
+  resetPumpStats();
   fifo.init(bufferSize);
   ws.onEvent([=] (WStype_t type, uint8_t * payload, size_t length) {
     webSocketEvent(type, payload, length);
@@ -31,22 +55,39 @@ AWSWebSocketClientAdapter::AWSWebSocketClientAdapter(WebSocketParams& p, size_t
 
 AWSWebSocketClientAdapter::~AWSWebSocketClientAdapter()
 {
+  if (writeBuffer != NULL) {
+    free(writeBuffer);
+  }
 }
 
 void AWSWebSocketClientAdapter::webSocketEvent(WStype_t type, uint8_t * payload, size_t length)
 {
   switch(type) {
+    case WStype_ERROR:
+      if (isConnecting && payload != 0) {
+        size_t n = length < sizeof(rejectReason) - 1 ? length : sizeof(rejectReason) - 1;
+        memcpy(rejectReason, payload, n);
+        rejectReason[n] = '\0';
+      }
+      break;
     case WStype_DISCONNECTED:
       isConnected = false;
+      // The TCP connection was up, but the server did not accept the
+      // handshake
+      if (isConnecting) {
+        wasRejected = true;
+      }
       break;
     case WStype_CONNECTED:
       isConnected = true;
       break;
     case WStype_TEXT:
-      fifo.push(payload, length);
+      receive(payload, length);
       break;
     case WStype_BIN:
-      fifo.push(payload, length);
+      receive(payload, length);
+      break;
+    default:
       break;
   }
 }
@@ -61,12 +102,338 @@ int AWSWebSocketClientAdapter::connect(IPAddress ip, uint16_t p)
   return connect(0, 0);
 }
 
+void AWSWebSocketClientAdapter::receive(uint8_t* payload, size_t length)
+{
+  receivedBytes += length;
+
+  if (!frameMode) {
+    if (!store(payload, length)) {
+      // Whatever the MQTT client reads next is out of sync
+      droppedFrames++;
+      droppedBytes += length;
+    }
+    return;
+  }
+
+  if (length == 0) {
+    return;
+  }
+  if (frameCount == MAX_FRAMES || !store(payload, length)) {
+    droppedFrames++;
+    droppedBytes += length;
+    return;
+  }
+  frameLengths[(frameHead + frameCount) & (MAX_FRAMES - 1)] = length;
+  frameCount++;
+}
+
+bool AWSWebSocketClientAdapter::store(uint8_t* payload, size_t length)
+{
+  if (fifo.push(payload, length)) {
+    return true;
+  }
+
+  if (overflowPolicy == OVERFLOW_GROW) {
+    size_t capacity = fifo.getCapacity() > 0 ? fifo.getCapacity() : 1;
+    while (capacity < fifo.getSize() + length) {
+      capacity <<= 1;
+    }
+    if (capacity <= overflowLimit && fifo.grow(capacity)) {
+      return fifo.push(payload, length);
+    }
+  }
+  return false;
+}
+
+void AWSWebSocketClientAdapter::setWriteBufferSize(size_t size)
+{
+  flush();
+  if (writeBuffer != NULL) {
+    free(writeBuffer);
+    writeBuffer = NULL;
+  }
+  writeBufferSize = 0;
+  if (size > 0) {
+    writeBuffer = (uint8_t*) malloc(WEBSOCKETS_MAX_HEADER_SIZE + size);
+    if (writeBuffer != NULL) {
+      writeBufferSize = size;
+    }
+  }
+}
+
+AWSWebSocketClientAdapter::WriteStats AWSWebSocketClientAdapter::getWriteStats()
+{
+  return writeStats;
+}
+
+void AWSWebSocketClientAdapter::resetWriteStats()
+{
+  writeStats.writes = 0;
+  writeStats.frames = 0;
+  writeStats.bytes = 0;
+}
+
+bool AWSWebSocketClientAdapter::countFrame(bool sent, size_t len)
+{
+  if (sent) {
+    writeStats.frames++;
+    writeStats.bytes += len;
+  }
+  return sent;
+}
+
+void AWSWebSocketClientAdapter::loop()
+{
+  // With backpressure, leave data in the socket until there is room for it.
+  // If the reserve is larger than the buffer, wait for it to run empty.
+  size_t reserve = overflowLimit < fifo.getCapacity() ? overflowLimit : fifo.getCapacity();
+  if (overflowPolicy != OVERFLOW_BACKPRESSURE || fifo.getFree() >= reserve) {
+    WsLock lock(*this);
+    ws.loop();
+  }
+}
+
+size_t AWSWebSocketClientAdapter::pump(unsigned long maxMicros, size_t maxBytes)
+{
+  unsigned long start = micros();
+  unsigned long before = receivedBytes;
+
+  for (;;) {
+    unsigned long last = receivedBytes;
+    loop();
+    pumpLoops++;
+
+    // Nothing more waiting, or out of budget
+    if (receivedBytes == last ||
+        (maxBytes > 0 && receivedBytes - before >= maxBytes) ||
+        (uint32_t) (micros() - start) >= maxMicros) {
+      break;
+    }
+  }
+
+  size_t received = receivedBytes - before;
+  pumpCalls++;
+  pumpBytes += received;
+  pumpMicros += (uint32_t) (micros() - start);
+  return received;
+}
+
+AWSWebSocketClientAdapter::PumpStats AWSWebSocketClientAdapter::getPumpStats()
+{
+  PumpStats stats;
+  stats.calls = pumpCalls;
+  stats.loops = pumpLoops;
+  stats.bytes = pumpBytes;
+  stats.micros = pumpMicros;
+  return stats;
+}
+
+void AWSWebSocketClientAdapter::resetPumpStats()
+{
+  pumpCalls = 0;
+  pumpLoops = 0;
+  pumpBytes = 0;
+  pumpMicros = 0;
+}
+
+void AWSWebSocketClientAdapter::setOverflowPolicy(OverflowPolicy policy, size_t limit)
+{
+  overflowPolicy = policy;
+  overflowLimit = limit;
+}
+
+AWSWebSocketClientAdapter::BufferStats AWSWebSocketClientAdapter::getBufferStats()
+{
+  BufferStats stats;
+  stats.capacity = fifo.getCapacity();
+  stats.highWaterMark = fifo.getHighWaterMark();
+  stats.droppedFrames = droppedFrames;
+  stats.droppedBytes = droppedBytes;
+  return stats;
+}
+
+void AWSWebSocketClientAdapter::resetBufferStats()
+{
+  fifo.resetHighWaterMark();
+  droppedFrames = 0;
+  droppedBytes = 0;
+}
+
+void AWSWebSocketClientAdapter::setFrameMode(bool enabled)
+{
+  // The frame queue is not thread-safe
+  frameMode = enabled && !AWS_IOT_WS_SPSC_RECEIVE_BUFFER;
+  frameHead = 0;
+  frameCount = 0;
+  frameOffset = 0;
+}
+
+int AWSWebSocketClientAdapter::peekFrame(ReceiveBuffer::Span spans[2])
+{
+  if (frameCount == 0) {
+    return -1;
+  }
+
+  size_t len = frameLengths[frameHead] - frameOffset;
+  fifo.getReadSpans(spans);
+  if (len <= spans[0].len) {
+    spans[0].len = len;
+    spans[1].len = 0;
+  } else {
+    spans[1].len = len - spans[0].len;
+  }
+  return len;
+}
+
+int AWSWebSocketClientAdapter::readFrame(uint8_t* buf, size_t size)
+{
+  if (frameCount == 0) {
+    return -1;
+  }
+
+  size_t len = frameLengths[frameHead] - frameOffset;
+  if (len <= size) {
+    fifo.pop(buf, len);
+    consumeFrames(len);
+  }
+  return len;
+}
+
+void AWSWebSocketClientAdapter::skipFrame()
+{
+  if (frameCount == 0) {
+    return;
+  }
+
+  size_t len = frameLengths[frameHead] - frameOffset;
+  fifo.consume(len);
+  consumeFrames(len);
+}
+
+size_t AWSWebSocketClientAdapter::peekBytes(uint8_t* buf, size_t size)
+{
+  fill(size);
+
+  ReceiveBuffer::Span spans[2];
+  fifo.getReadSpans(spans);
+
+  size_t n = 0;
+  for (int i = 0; i < 2 && n < size; ++i) {
+    size_t len = spans[i].len < size - n ? spans[i].len : size - n;
+    memcpy(buf + n, spans[i].data, len);
+    n += len;
+  }
+  return n;
+}
+
+size_t AWSWebSocketClientAdapter::fill(size_t size)
+{
+#if !AWS_IOT_WS_SPSC_RECEIVE_BUFFER
+  // A packet may be split over several frames, and with backpressure the
+  // rest is only received once there is room
+  while (fifo.getSize() < size && pump(0) > 0) {
+  }
+#endif
+  return fifo.getSize();
+}
+
+void AWSWebSocketClientAdapter::consumeFrames(size_t len)
+{
+  while (len > 0 && frameCount > 0) {
+    size_t rest = frameLengths[frameHead] - frameOffset;
+    if (len < rest) {
+      frameOffset += len;
+      return;
+    }
+    len -= rest;
+    frameHead = (frameHead + 1) & (MAX_FRAMES - 1);
+    frameCount--;
+    frameOffset = 0;
+  }
+}
+
 /*
  * Completely disregards arguments. Uses config values instead.
  *
+ * If the handshake is rejected, e.g. because the clock was off when the
+ * path was signed, the params get a chance to correct that and the
+ * handshake is retried at once.
+ *
  * Returns true if successful, false otherwise
  */
  int AWSWebSocketClientAdapter::connect(const char *h, uint16_t p)
+{
+  beginConnect();
+
+  ConnectStatus status;
+  while ((status = pollConnect()) == CONNECT_PENDING) {
+    delay(10);
+  }
+  return status == CONNECT_DONE;
+}
+
+void AWSWebSocketClientAdapter::beginConnect()
+{
+  connectStatus = CONNECT_PENDING;
+  handshakeRetries = 0;
+  beginHandshake();
+}
+
+AWSWebSocketClientAdapter::ConnectStatus AWSWebSocketClientAdapter::pollConnect()
+{
+  if (connectStatus != CONNECT_PENDING) {
+    return connectStatus;
+  }
+
+  // Events may also be handled by loop() on the receiving thread, so
+  // the rejection is only looked at under the lock
+  bool rejected;
+  char reason[sizeof(rejectReason)];
+  {
+    WsLock lock(*this);
+    ws.loop();
+    rejected = wasRejected;
+    memcpy(reason, rejectReason, sizeof(reason));
+  }
+
+  if (connected()) {
+    isConnecting = false;
+    connectStatus = CONNECT_DONE;
+    return connectStatus;
+  }
+
+  // The server closed the connection during the handshake
+  if (rejected) {
+    if (handshakeRetries < HANDSHAKE_RETRIES &&
+        params.handshakeRejected(reason[0] != '\0' ? reason : 0)) {
+      handshakeRetries++;
+      {
+        WsLock lock(*this);
+        ws.disconnect();
+      }
+      beginHandshake();
+      return connectStatus;
+    }
+    isConnecting = false;
+    connectStatus = CONNECT_FAILED;
+    return connectStatus;
+  }
+
+  if ((uint32_t) (millis() - handshakeStartedAt) >= connectTimeout) {
+    isConnecting = false;
+    WsLock lock(*this);
+    ws.disconnect();
+    connectStatus = CONNECT_FAILED;
+  }
+  return connectStatus;
+}
+
+void AWSWebSocketClientAdapter::setConnectTimeout(unsigned long ms)
+{
+  connectTimeout = ms;
+}
+
+void AWSWebSocketClientAdapter::beginHandshake()
 {
   const char* host = params.getHost();
   const int port = params.getPort();
@@ -75,21 +442,18 @@ int AWSWebSocketClientAdapter::connect(IPAddress ip, uint16_t p)
   const char* protocol = params.getProtocol();
   const bool useSsl = params.useSsl();
 
+  WsLock lock(*this);
   if (useSsl) {
     ws.beginSSL(host, port, path, fingerprint, protocol);
   } else {
     ws.begin(host, port, path, fingerprint);
   }
 
-  // Wait until connected
-  long connectionTimeout = 5000;
-  long now = millis();
-  while((millis() - now) < connectionTimeout) {
-    ws.loop();
-    if(connected()) return true;
-    delay (10);
-  }
-  return false;
+  // Wait until connected, or until the server closes the connection
+  isConnecting = true;
+  wasRejected = false;
+  rejectReason[0] = '\0';
+  handshakeStartedAt = millis();
 }
 
 size_t AWSWebSocketClientAdapter::write(uint8_t b)
@@ -102,13 +466,33 @@ size_t AWSWebSocketClientAdapter::write(uint8_t b)
 
 size_t AWSWebSocketClientAdapter::write(const uint8_t *buf, size_t size)
 {
-  if (!connected())
+  if (!connected() || size == 0)
     return 0;
 
-  if (ws.sendBIN(buf,size))
-  	  return size;
+  writeStats.writes++;
+
+  if (writeLen + size > writeBufferSize) {
+    flush();
+  }
 
-  return 0;
+  // Too large to stage, send as is
+  if (size > writeBufferSize) {
+    bool sent;
+    {
+      WsLock lock(*this);
+      sent = ws.sendBIN(buf, size);
+    }
+    if (countFrame(sent, size))
+      return size;
+    return 0;
+  }
+
+  memcpy(writeBuffer + WEBSOCKETS_MAX_HEADER_SIZE + writeLen, buf, size);
+  writeLen += size;
+  if (writeLen == writeBufferSize) {
+    flush();
+  }
+  return size;
 }
 
 int AWSWebSocketClientAdapter::available()
@@ -116,9 +500,12 @@ int AWSWebSocketClientAdapter::available()
   if (!connected())
     return false;
 
-  ws.loop();
+  // Whatever is read next may be the reply to what was written
+  flush();
 
-  return fifo.getSize();
+  // Paho waits for replies by polling available(), so receive if there is
+  // nothing to return. Otherwise leave it to pump() and the reads.
+  return fill(1);
 }
 
 int AWSWebSocketClientAdapter::read()
@@ -126,6 +513,12 @@ int AWSWebSocketClientAdapter::read()
   if (!connected())
     return EXIT_FAILURE;
 
+  if (fill(1) == 0) {
+    return -1;
+  }
+  if (frameMode) {
+    consumeFrames(1);
+  }
   return fifo.pop();
 }
 
@@ -134,8 +527,12 @@ int AWSWebSocketClientAdapter::read(uint8_t *buf, size_t size)
   if (!connected())
     return EXIT_FAILURE;
 
-  int s = (fifo.getSize() < size) ? fifo.getSize() : size;
+  size_t buffered = fill(size);
+  int s = (buffered < size) ? buffered : size;
   fifo.pop(buf, s);
+  if (frameMode) {
+    consumeFrames(s);
+  }
 
   return s;
 }
@@ -145,19 +542,43 @@ int AWSWebSocketClientAdapter::peek()
   if (!connected())
     return EXIT_FAILURE;
 
+  fill(1);
   return fifo.peek();
 }
 
 void AWSWebSocketClientAdapter::flush()
 {
-  // do nothing
+  if (writeLen == 0) {
+    return;
+  }
+
+  // Data is lost if the send fails, the connection is broken then anyway
+  // The header is put in front of the data, and the data masked, in place
+  if (connected()) {
+    bool sent;
+    {
+      WsLock lock(*this);
+      sent = ws.sendBIN(writeBuffer, writeLen, true);
+    }
+    countFrame(sent, writeLen);
+  }
+  writeLen = 0;
 }
 
 void AWSWebSocketClientAdapter::stop()
 {
+  isConnecting = false;
+  connectStatus = CONNECT_IDLE;
+  flush();
+
+  // Also keeps loop() from pushing while the buffer is cleared
+  WsLock lock(*this);
   if(connected()) {
     isConnected = false;
     fifo.clear();
+    frameHead = 0;
+    frameCount = 0;
+    frameOffset = 0;
   }
   ws.disconnect();
 }
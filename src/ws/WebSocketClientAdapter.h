@@ -21,7 +21,13 @@
 #include <Hash.h>
 #include <WebSocketsClient.h>
 
+#include "aws_iot_config.h"
 #include "ws/CircularByteBuffer.h"
+#if AWS_IOT_WS_SPSC_RECEIVE_BUFFER
+#include <atomic>
+#include <mutex>
+#include "ws/SpscByteBuffer.h"
+#endif
 
 /*
  * WebSocketParams provides connection parameters for the AWSWebSocketClientAdapter
@@ -40,6 +46,12 @@ public:
   virtual char* getProtocol()    =0;
   virtual bool useSsl()          =0;
   virtual ~WebSocketParams()     =0;
+
+  // Called when the server closed the connection during the handshake, e.g.
+  // because the signature in the path was rejected. reason is the error
+  // reported by the server, or null if not known. Returns true if the params
+  // were updated and connecting again right away may succeed.
+  virtual bool handshakeRejected(const char* reason) { return false; }
 };
 
 /**
@@ -62,9 +74,131 @@ class AWSWebSocketClientAdapter : public Client
 {
 public:
 
-  AWSWebSocketClientAdapter(WebSocketParams& p, size_t bufferSize = 1000);
+#if AWS_IOT_WS_SPSC_RECEIVE_BUFFER
+  typedef SpscByteBuffer ReceiveBuffer;
+#else
+  typedef CircularByteBuffer ReceiveBuffer;
+#endif
+
+  // What to do with a received frame that doesn't fit in the buffer
+  enum OverflowPolicy {
+    // Drop the frame. Default.
+    OVERFLOW_DROP,
+    // Double the buffer until the frame fits, up to a limit
+    OVERFLOW_GROW,
+    // Stop reading from the websocket while less than a reserve is free.
+    // Unread data is left in the TCP receive window, which slows down the
+    // sender.
+    OVERFLOW_BACKPRESSURE
+  };
+
+  // Progress of a connect started with beginConnect()
+  enum ConnectStatus {
+    CONNECT_IDLE,
+    CONNECT_PENDING,
+    CONNECT_DONE,
+    CONNECT_FAILED
+  };
+
+  // Receive buffer statistics, to tune buffer size and policy
+  struct BufferStats {
+    size_t capacity;
+    size_t highWaterMark;
+    unsigned long droppedFrames;
+    unsigned long droppedBytes;
+  };
+
+  // pump() statistics. bytes/calls is the average received per pump.
+  struct PumpStats {
+    unsigned long calls;
+    unsigned long loops;
+    unsigned long bytes;
+    unsigned long micros;
+  };
+
+  // Send statistics. writes/frames is the number of write() calls
+  // coalesced into one frame.
+  struct WriteStats {
+    unsigned long writes;
+    unsigned long frames;
+    unsigned long bytes;
+  };
+
+  AWSWebSocketClientAdapter(WebSocketParams& p, size_t bufferSize = 1024);
   ~AWSWebSocketClientAdapter();
 
+  // Start connecting without waiting for the handshake. Call pollConnect()
+  // until it no longer returns CONNECT_PENDING. Note that the TCP and TLS
+  // connect of arduinoWebSockets itself blocks, in the first pollConnect().
+  void beginConnect();
+  ConnectStatus pollConnect();
+
+  // Time (ms) to wait for the websocket handshake. Defaults to 5000.
+  void setConnectTimeout(unsigned long ms);
+
+  // Collect written data in a buffer of size bytes and send it as one
+  // websocket frame on flush(), when the buffer is full, or before reading.
+  // Also saves a copy per frame in arduinoWebSockets. 0 (the default) sends
+  // every write() as a frame of its own.
+  void setWriteBufferSize(size_t size);
+
+  WriteStats getWriteStats();
+  void resetWriteStats();
+
+  // Receive frames and handle control frames, once. With
+  // AWS_IOT_WS_SPSC_RECEIVE_BUFFER, only the receiving thread may call this
+  // or pump(), and the MQTT client reads, writes, connects and stops.
+  // arduinoWebSockets itself is not thread-safe, so all calls into it are
+  // serialized with a mutex then, i.e. a write waits for a running loop().
+  // The statistics may be read from either thread.
+  void loop();
+
+  // Receive until no more data is waiting, or the budget is used up: at
+  // most maxMicros, and (if not 0) maxBytes. loop() is called at least
+  // once. Returns the number of bytes received. The read functions only
+  // receive while fewer bytes are buffered than asked for, so call this
+  // regularly.
+  size_t pump(unsigned long maxMicros, size_t maxBytes = 0);
+
+  PumpStats getPumpStats();
+  void resetPumpStats();
+
+  // Set the overflow policy. For OVERFLOW_GROW, limit is the maximum buffer
+  // size. For OVERFLOW_BACKPRESSURE, it is the free space needed before the
+  // websocket is read again, i.e. the largest frame expected. Frames that
+  // don't fit despite the policy are dropped.
+  void setOverflowPolicy(OverflowPolicy policy, size_t limit = 0);
+
+  BufferStats getBufferStats();
+
+  // Reset dropped frame counters and high-water mark
+  void resetBufferStats();
+
+  // In frame mode, the boundaries of the received websocket frames are
+  // kept, so whole frames can be taken with peekFrame() and readFrame()
+  // instead of byte by byte. AWS IoT sends one MQTT packet per frame. The
+  // byte oriented read() functions can still be used, they consume the
+  // current frame. Set before connect().
+  void setFrameMode(bool enabled);
+
+  // Return the (rest of the) next frame in place as at most two spans,
+  // valid until the next call to available() or any read. Returns its
+  // length, or -1 if there is no frame.
+  int peekFrame(ReceiveBuffer::Span spans[2]);
+
+  // Copy the next frame to buf and remove it. Returns its length. If that is
+  // larger than size, nothing is copied and the frame is kept. Returns -1
+  // if there is no frame.
+  int readFrame(uint8_t* buf, size_t size);
+
+  // Remove the next frame, e.g. after peekFrame()
+  void skipFrame();
+
+  // Copy up to size received bytes to buf without removing them, e.g. to
+  // look at the header of the next packet. Receives first if fewer are
+  // buffered. Returns the number copied.
+  size_t peekBytes(uint8_t* buf, size_t size);
+
   // Arduino Client.h interface
   virtual int connect(IPAddress ip, uint16_t port);
   virtual int connect(const char *host, uint16_t port);
@@ -81,17 +215,110 @@ public:
 
 private:
 
+#if AWS_IOT_WS_SPSC_RECEIVE_BUFFER
+  // Written by one thread and read by the other
+  typedef std::atomic<unsigned long> SharedCounter;
+  typedef std::atomic<bool> SharedFlag;
+#else
+  typedef unsigned long SharedCounter;
+  typedef bool SharedFlag;
+#endif
+
   // Websocket implementation
   WebSocketsClient ws;
 
+#if AWS_IOT_WS_SPSC_RECEIVE_BUFFER
+  std::mutex wsMutex;
+#endif
+
+  // Held while calling into ws. Only locks with
+  // AWS_IOT_WS_SPSC_RECEIVE_BUFFER, where loop() runs on another thread.
+  class WsLock
+  {
+  public:
+#if AWS_IOT_WS_SPSC_RECEIVE_BUFFER
+    WsLock(AWSWebSocketClientAdapter& a) : lock(a.wsMutex) {}
+  private:
+    std::lock_guard<std::mutex> lock;
+#else
+    WsLock(AWSWebSocketClientAdapter& a) {}
+#endif
+  };
+
   // Used for buffering data when reading/writing
-  CircularByteBuffer fifo;
+  ReceiveBuffer fifo;
+
+  OverflowPolicy overflowPolicy;
+  size_t overflowLimit;
+  SharedCounter droppedFrames;
+  SharedCounter droppedBytes;
+
+  // Bytes of all frames passed to receive(), including dropped ones. Only
+  // used on the receiving thread.
+  unsigned long receivedBytes;
+
+  // See PumpStats
+  SharedCounter pumpCalls;
+  SharedCounter pumpLoops;
+  SharedCounter pumpBytes;
+  SharedCounter pumpMicros;
+
+  // Lengths of the frames in fifo, in frame mode. Frames arriving when
+  // full are dropped. Must be a power of two.
+  static const size_t MAX_FRAMES = 16;
+  bool frameMode;
+  size_t frameLengths[MAX_FRAMES];
+  size_t frameHead;
+  size_t frameCount;
+
+  // Bytes of the oldest frame already consumed by read()
+  size_t frameOffset;
+
+  // Account for len bytes taken from fifo in frame mode
+  void consumeFrames(size_t len);
+
+  // Receive while fewer than size bytes are buffered and more keeps
+  // arriving. With AWS_IOT_WS_SPSC_RECEIVE_BUFFER, the receiving thread
+  // does that. Returns the bytes buffered.
+  size_t fill(size_t size);
+
+  // Written data not sent yet, after WEBSOCKETS_MAX_HEADER_SIZE bytes of
+  // room for the frame header
+  uint8_t* writeBuffer;
+  size_t writeBufferSize;
+  size_t writeLen;
+  WriteStats writeStats;
+
+  // Count a sent frame
+  bool countFrame(bool sent, size_t len);
 
   // Connection params used instead of connect() arguments
   WebSocketParams& params;
 
   // Tracks connection state
-  bool isConnected;
+  SharedFlag isConnected;
+
+  // Set while waiting for the handshake
+  SharedFlag isConnecting;
+
+  ConnectStatus connectStatus;
+  unsigned long connectTimeout;
+  unsigned long handshakeStartedAt;
+  int handshakeRetries;
+
+  // Set if the connection was closed during the handshake. Like
+  // rejectReason, only accessed while holding WsLock.
+  bool wasRejected;
+
+  // Error reported while connecting, if any
+  char rejectReason[128];
+
+  // Start the websocket handshake
+  void beginHandshake();
+
+  // Buffer a received frame according to the overflow policy
+  void receive(uint8_t* payload, size_t length);
+  bool store(uint8_t* payload, size_t length);
 
   // Callback handling websocket events
   void webSocketEvent(WStype_t type, uint8_t * payload, size_t length);